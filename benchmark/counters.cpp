@@ -1,8 +1,27 @@
 // Fine-grained statistics is available only on Linux
 #include "fastscancount.h"
+#include "fastscancount_amac.h"
+#include "fastscancount_boolean.h"
+#include "fastscancount_cache.h"
+#include "fastscancount_deleted.h"
+#include "fastscancount_estimate.h"
+#include "fastscancount_hugepages.h"
+#include "fastscancount_merge.h"
+#include "fastscancount_nibble.h"
+#include "fastscancount_prefetch.h"
+#include "fastscancount_segmented.h"
+#include "fastscancount_shard.h"
+#include "fastscancount_specialized.h"
+#include "fastscancount_windowed.h"
+#include "fastscancount_16bit.h"
+#include "fastscancount_stream.h"
+#include "fastscancount_unsorted.h"
 #include "ztimer.h"
 #ifdef __AVX2__
 #include "fastscancount_avx2.h"
+#include "fastscancount_bitmap.h"
+#include "fastscancount_histogram.h"
+#include "fastscancount_groups.h"
 #endif
 #ifdef __AVX512F__
 #include "fastscancount_avx512.h"
@@ -10,16 +29,59 @@
 #include "linux-perf-events-wrapper.h"
 #include "maropuparser.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <immintrin.h>
 #include <iostream>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 
 #define REPEATS 10
 #define RUNNINGTESTS
 
+// set by --hugepages: back postings, outputs and the baseline counters
+// with huge pages, and report dTLB misses
+bool use_hugepages = false;
+
+// set by --cache-mb: replay the queries through a result cache of that size
+size_t cache_mb = 0;
+
+// set by --stream: count from the postings file instead of loading it,
+// --drop-cache evicts the file from the page cache before each query and
+// --pread-threads uses a pool of pread threads instead of io_uring
+bool stream_mode = false;
+bool drop_page_cache = false;
+size_t pread_threads = 0;
+
+// set by --replay: measure the latency of each query instead; --qps sets an
+// open-loop arrival rate, --clients the number of client threads and
+// --latency-out a CSV file that receives every latency
+bool replay_mode = false;
+double replay_qps = 0;
+size_t replay_clients = 1;
+std::string latency_file;
+
+// set by --segmented: rebuild the postings as a segmented index and query it
+bool segmented_mode = false;
+
+// set by --shards: serve the queries from that many worker processes
+// sharing the postings in shared memory
+uint32_t shard_count = 0;
+
+// set by --prefetch-distance (in elements) for fastscancount_prefetch
+size_t prefetch_distance = 512;
+
+template <typename counter_vector = std::vector<uint8_t>>
 void scancount(const std::vector<const std::vector<uint32_t>*> &data,
                std::vector<uint32_t> &out, size_t threshold) {
   uint64_t largest = 0;
@@ -27,7 +89,7 @@ void scancount(const std::vector<const std::vector<uint32_t>*> &data,
     const std::vector<uint32_t> & v = *z;
     if(v[v.size() - 1] > largest) largest = v[v.size() - 1];
   }
-  std::vector<uint8_t> counters(largest+1);
+  counter_vector counters(largest+1);
   out.clear();
   for (size_t c = 0; c < data.size(); c++) {
     const std::vector<uint32_t> &v = *data[c];
@@ -75,15 +137,20 @@ void calc_alldata_boundaries(const std::vector<std::vector<uint32_t>>& data,
   }
 }
 
+// when sorted is true, f() must also produce its answer in increasing order
 template <typename F>
 void test(F f, const std::vector<const std::vector<uint32_t>*>& data_ptrs,
-          std::vector<uint32_t>& answer, unsigned threshold, const std::string &name) {
+          std::vector<uint32_t>& answer, unsigned threshold, const std::string &name,
+          bool sorted = false) {
   scancount(data_ptrs, answer, threshold);
   size_t s1 = answer.size();
   auto a1 (answer);
   std::sort(a1.begin(), a1.end());
   answer.clear();
   f();
+  if (sorted && !std::is_sorted(answer.begin(), answer.end())) {
+    throw std::runtime_error("bug: unsorted output from " + name);
+  }
   size_t s2 = answer.size();
   auto a2 (answer);
   std::sort(a2.begin(), a2.end());
@@ -99,19 +166,153 @@ void test(F f, const std::vector<const std::vector<uint32_t>*>& data_ptrs,
   }
 }
 
+// histogram[k] is the number of values occurring exactly k times
+void scancount_histogram(const std::vector<const std::vector<uint32_t>*> &data,
+                         std::vector<uint64_t> &histogram) {
+  uint64_t largest = 0;
+  for(auto z : data) {
+    const std::vector<uint32_t> & v = *z;
+    if(v[v.size() - 1] > largest) largest = v[v.size() - 1];
+  }
+  std::vector<uint8_t> counters(largest+1);
+  for (size_t c = 0; c < data.size(); c++) {
+    const std::vector<uint32_t> &v = *data[c];
+    for (size_t i = 0; i < v.size(); i++) {
+      counters[v[i]]++;
+    }
+  }
+  histogram.assign(256, 0);
+  for (uint8_t c : counters) {
+    if (c > 0)
+      histogram[c]++;
+  }
+}
+
+#ifdef __AVX2__
+void test_histogram(const std::vector<const std::vector<uint32_t>*> &data,
+                    std::vector<uint32_t> &answer, unsigned threshold) {
+  std::vector<uint64_t> expected, histogram;
+  std::vector<std::vector<uint32_t>> outs;
+  scancount_histogram(data, expected);
+  fastscancount::fastscancount_histogram(data, histogram, {uint8_t(threshold)}, outs);
+  if (histogram != expected) {
+    throw std::runtime_error("bug: fastscancount_histogram");
+  }
+  test(
+    [&](){
+      answer.swap(outs[0]);
+    }, data, answer, threshold, "fastscancount_histogram", true
+  );
+}
+#endif
+
+// Splits a query for the boolean benchmarks: when there are at least three
+// lists, the shortest one is required and the second shortest is excluded.
+void split_boolean_query(const std::vector<const std::vector<uint32_t>*> &data,
+                         std::vector<const std::vector<uint32_t>*> &required,
+                         std::vector<const std::vector<uint32_t>*> &excluded,
+                         std::vector<const std::vector<uint32_t>*> &optional) {
+  optional = data;
+  required.clear();
+  excluded.clear();
+  if (optional.size() < 3) {
+    return;
+  }
+  std::sort(optional.begin(), optional.end(),
+            [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b) {
+              return a->size() < b->size();
+            });
+  required.push_back(optional[0]);
+  excluded.push_back(optional[1]);
+  optional.erase(optional.begin(), optional.begin() + 2);
+}
+
+void boolean_scancount(const std::vector<const std::vector<uint32_t>*> &required,
+                       const std::vector<const std::vector<uint32_t>*> &excluded,
+                       const std::vector<const std::vector<uint32_t>*> &optional,
+                       std::vector<uint32_t> &out, size_t threshold) {
+  std::vector<uint32_t> candidates;
+  scancount(optional, candidates, threshold);
+  out.clear();
+  for (uint32_t val : candidates) {
+    bool ok = true;
+    for (auto d : required) {
+      ok = ok && std::binary_search(d->begin(), d->end(), val);
+    }
+    for (auto d : excluded) {
+      ok = ok && !std::binary_search(d->begin(), d->end(), val);
+    }
+    if (ok) {
+      out.push_back(val);
+    }
+  }
+}
+
+void test_boolean(const std::vector<const std::vector<uint32_t>*> &required,
+                  const std::vector<const std::vector<uint32_t>*> &excluded,
+                  const std::vector<const std::vector<uint32_t>*> &optional,
+                  std::vector<uint32_t> &answer, unsigned threshold) {
+  std::vector<uint32_t> expected;
+  boolean_scancount(required, excluded, optional, expected, threshold);
+  fastscancount::fastscancount_boolean(required, excluded, optional, answer, threshold);
+  if (answer != expected) {
+    std::cout << "s1: " << expected.size() << " s2: " << answer.size() << std::endl;
+    throw std::runtime_error("bug: fastscancount_boolean");
+  }
+}
+
+// about one document in one_in is deleted
+std::vector<uint64_t> random_deletions(size_t N, size_t one_in) {
+  std::vector<uint64_t> deleted((N + 63) / 64);
+  std::mt19937 gen(1234);
+  for (size_t i = 0; i < N; i++) {
+    if (gen() % one_in == 0) {
+      fastscancount::mark_deleted(deleted, uint32_t(i));
+    }
+  }
+  return deleted;
+}
+
+// what the deletion masks save: filtering the hits afterwards
+void remove_deleted(std::vector<uint32_t> &answer, const std::vector<uint64_t> &deleted) {
+  answer.erase(std::remove_if(answer.begin(), answer.end(),
+                              [&](uint32_t val) { return fastscancount::is_deleted(deleted, val); }),
+               answer.end());
+}
+
+// f() must produce the live hits, in increasing order
+template <typename F>
+void test_deleted(F f, const std::vector<const std::vector<uint32_t>*>& data_ptrs,
+                  const std::vector<uint64_t> &deleted,
+                  std::vector<uint32_t>& answer, unsigned threshold, const std::string &name) {
+  std::vector<uint32_t> expected;
+  scancount(data_ptrs, expected, threshold);
+  remove_deleted(expected, deleted);
+  std::sort(expected.begin(), expected.end());
+  answer.clear();
+  f();
+  if (answer != expected) {
+    std::cout << "s1: " << expected.size() << " s2: " << answer.size() << std::endl;
+    throw std::runtime_error("bug: " + name + " with deletions");
+  }
+}
+
+// result_size, when given, replaces answer.size() for kernels that write
+// their hits elsewhere; it is called after the timed region
 template <typename F>
 void bench(F f, const std::string &name,
            LinuxEventsWrapper &unified,
            float& elapsed,
            std::vector<uint32_t> &answer, size_t sum, size_t expected,
-           bool print) {
+           bool print, const std::function<size_t()> &result_size = nullptr) {
   WallClockTimer tm;
   unified.start();
   f();
   unified.end();
   elapsed += tm.split();
-  if (answer.size() != expected)
-    std::cerr << "bug: expected " << expected << " but got " << answer.size()
+  const size_t got = result_size ? result_size() : answer.size();
+  if (got != expected)
+    std::cerr << "bug: expected " << expected << " but got " << got
               << "\n";
 #ifdef __linux__
   if (print) {
@@ -122,10 +323,28 @@ void bench(F f, const std::string &name,
     std::cout << cycles / sum << " cycles/element " << std::endl;
     std::cout << instructions / cycles << " instructions/cycles " << std::endl;
     std::cout << misses / sum << " miss/element " << std::endl;
+    if (use_hugepages) {
+      double tlb_misses = unified.get_result(cache_read_miss_event(PERF_COUNT_HW_CACHE_DTLB));
+      std::cout << tlb_misses / sum << " dTLB miss/element " << std::endl;
+    }
   }
 #endif
 }
 
+// what fastscancount_unsorted saves: sorting copies of the lists first
+void sort_then_fastscancount(const std::vector<const std::vector<uint32_t>*> &data,
+                             std::vector<std::vector<uint32_t>> &copies,
+                             std::vector<uint32_t> &out, size_t threshold) {
+  copies.resize(data.size());
+  std::vector<const std::vector<uint32_t>*> ptrs;
+  for (size_t c = 0; c < data.size(); c++) {
+    copies[c].assign(data[c]->begin(), data[c]->end());
+    std::sort(copies[c].begin(), copies[c].end());
+    ptrs.push_back(&copies[c]);
+  }
+  fastscancount::fastscancount(ptrs, out, threshold);
+}
+
 void demo_data(const std::vector<std::vector<uint32_t>>& data,
               const std::vector<std::vector<uint32_t>>& queries,
               size_t threshold) {
@@ -138,7 +357,11 @@ void demo_data(const std::vector<std::vector<uint32_t>>& data,
   }
 
   std::vector<uint32_t> answer;
-  answer.reserve(N);
+  if (use_hugepages) {
+    fastscancount::reserve_hugepages(answer, N);
+  } else {
+    answer.reserve(N);
+  }
 
   std::vector<int> evts = {
 #ifdef __linux__
@@ -149,15 +372,53 @@ void demo_data(const std::vector<std::vector<uint32_t>>& data,
                            PERF_COUNT_HW_CACHE_MISSES
 #endif
                           };
-  LinuxEventsWrapper unified(evts);
+  std::vector<int> cache_evts;
+#ifdef __linux__
+  if (use_hugepages) {
+    cache_evts.push_back(cache_read_miss_event(PERF_COUNT_HW_CACHE_DTLB));
+  }
+#endif
+  LinuxEventsWrapper unified(evts, cache_evts);
 
   std::vector<std::vector<uint32_t>> range_boundaries;
   calc_alldata_boundaries(data, range_boundaries, range_size_avx512);
 
+  fastscancount::windowed_index windowed;
+  {
+    WallClockTimer tm;
+    fastscancount::build_windowed_index(data, windowed);
+    std::cout << "built the window-major index in " << tm.split() << " us" << std::endl;
+  }
+  std::vector<std::vector<uint16_t>> packed(data.size());
+  for (size_t c = 0; c < data.size(); c++) {
+    fastscancount::pack16(data[c], packed[c]);
+  }
+  std::vector<const std::vector<uint16_t>*> packed_ptrs;
+  // the same lists in random order, as they would come out of a filter
+  std::vector<std::vector<uint32_t>> shuffled(data);
+  std::mt19937 gen(1234);
+  for (auto& v : shuffled) {
+    std::shuffle(v.begin(), v.end(), gen);
+  }
+  std::vector<const std::vector<uint32_t>*> unsorted_ptrs;
+  std::vector<std::vector<uint32_t>> sorted_copies;
+
   std::vector<const std::vector<uint32_t>*> data_ptrs;
   std::vector<const std::vector<uint32_t>*> range_ptrs;
+  std::vector<const std::vector<uint32_t>*> required_ptrs, excluded_ptrs, optional_ptrs;
+#ifdef __AVX2__
+  fastscancount::hit_set hits;
+#endif
+  const std::vector<uint64_t> deleted = random_deletions(N, 10);
 
-  float elapsed = 0, elapsed_fast = 0, elapsed_avx = 0, elapsed_avx512 = 0;
+  float elapsed = 0, elapsed_huge = 0, elapsed_fast = 0, elapsed_specialized = 0, elapsed_sorted = 0, elapsed_merge = 0, elapsed_prefetch = 0, elapsed_windowed = 0,
+        elapsed_16bit = 0, elapsed_16bit_avx = 0, elapsed_avx = 0, elapsed_avx512 = 0,
+        elapsed_nibble = 0, elapsed_nibble_avx = 0, elapsed_amac = 0;
+  float elapsed_boolean_ref = 0, elapsed_boolean = 0, elapsed_bitmap = 0;
+  float elapsed_estimate = 0, elapsed_unsorted = 0, elapsed_sort_first = 0;
+  float elapsed_filter_avx = 0, elapsed_masked_avx = 0, elapsed_filter_avx512 = 0, elapsed_masked_avx512 = 0;
+  size_t estimates_within = 0;
+  double estimate_error = 0;
 
   size_t sum_total = 0;
 
@@ -166,6 +427,8 @@ void demo_data(const std::vector<std::vector<uint32_t>>& data,
     data_ptrs.clear();
     range_ptrs.clear();
     size_t sum = 0;
+    packed_ptrs.clear();
+    unsorted_ptrs.clear();
     for (uint32_t idx : query_elem) {
       if (idx >= data.size()) {
         std::stringstream err;
@@ -176,34 +439,148 @@ void demo_data(const std::vector<std::vector<uint32_t>>& data,
       sum += data[idx].size();
       data_ptrs.push_back(&data[idx]);
       range_ptrs.push_back(&range_boundaries[idx]);
+      packed_ptrs.push_back(&packed[idx]);
+      unsorted_ptrs.push_back(&shuffled[idx]);
     }
     sum_total += sum;
 
     scancount(data_ptrs, answer, threshold);
     const size_t expected = answer.size();
 
+    {
+      WallClockTimer tm;
+      fastscancount::hit_estimate estimate = fastscancount::fastscancount_estimate(data_ptrs, threshold);
+      elapsed_estimate += tm.split();
+      if (estimate.low <= expected && expected <= estimate.high) {
+        estimates_within++;
+      }
+      estimate_error += std::fabs(estimate.hits - expected) / std::max<size_t>(expected, 1);
+    }
+
 #ifdef RUNNINGTESTS
     test(
       [&](){
         fastscancount::fastscancount(data_ptrs, answer, threshold);
       }, data_ptrs, answer, threshold, "fastscancount"
     );
+    test(
+      [&](){
+        fastscancount::fastscancount_sorted(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_sorted", true
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_specialized(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_specialized"
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_merge(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_merge", true
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_amac(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_amac"
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_nibble(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_nibble"
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_unsorted(unsorted_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_unsorted"
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_prefetch(data_ptrs, answer, threshold, prefetch_distance);
+      }, data_ptrs, answer, threshold, "fastscancount_prefetch"
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_windowed(windowed, query_elem, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_windowed"
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_16bit(packed_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_16bit"
+    );
+#ifdef __AVX2__
+    test(
+      [&](){
+        fastscancount::fastscancount_16bit_avx2(packed_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_16bit_avx2", true
+    );
+#endif
 #ifdef __AVX2__
     test(
       [&](){
         fastscancount::fastscancount_avx2(data_ptrs, answer, threshold);
-      }, data_ptrs, answer, threshold, "fastscancount_avx2"
+      }, data_ptrs, answer, threshold, "fastscancount_avx2", true
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_nibble_avx2(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_nibble_avx2", true
+    );
+    test(
+      [&](){
+        fastscancount::fastscancount_bitmap(data_ptrs, hits, threshold);
+        hits.to_vector(answer);
+      }, data_ptrs, answer, threshold, "fastscancount_bitmap", true
     );
+    test_histogram(data_ptrs, answer, threshold);
+    {
+      // materialize the first half of the query as a group
+      const size_t half = data_ptrs.size() / 2;
+      std::vector<const std::vector<uint32_t>*> members(data_ptrs.begin(), data_ptrs.begin() + half);
+      std::vector<const std::vector<uint32_t>*> rest(data_ptrs.begin() + half, data_ptrs.end());
+      fastscancount::materialized_group group;
+      fastscancount::materialize_group(members, group);
+      test(
+        [&](){
+          fastscancount::fastscancount_groups({&group}, rest, answer, threshold);
+        }, data_ptrs, answer, threshold, "fastscancount_groups", true
+      );
+    }
 #endif
 
 #ifdef __AVX512F__
     test(
       [&](){
         fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold);
-      }, data_ptrs, answer, threshold, "fastscancount_avx512"
+      }, data_ptrs, answer, threshold, "fastscancount_avx512", true
     );
 #endif
 
+#endif
+    split_boolean_query(data_ptrs, required_ptrs, excluded_ptrs, optional_ptrs);
+    boolean_scancount(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+    const size_t expected_boolean = answer.size();
+#ifdef RUNNINGTESTS
+    test_boolean(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+#endif
+    scancount(data_ptrs, answer, threshold);
+    remove_deleted(answer, deleted);
+    const size_t expected_live = answer.size();
+#ifdef RUNNINGTESTS
+#ifdef __AVX2__
+    test_deleted(
+      [&](){
+        fastscancount::fastscancount_avx2(data_ptrs, answer, threshold, &deleted);
+      }, data_ptrs, deleted, answer, threshold, "fastscancount_avx2"
+    );
+#endif
+#ifdef __AVX512F__
+    test_deleted(
+      [&](){
+        fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold, &deleted);
+      }, data_ptrs, deleted, answer, threshold, "fastscancount_avx512"
+    );
+#endif
 #endif
     std::cout << "Qid: " << qid << " got " << expected << " hits\n";
 
@@ -216,18 +593,106 @@ void demo_data(const std::vector<std::vector<uint32_t>>& data,
         "baseline scancount", unified, elapsed, answer, sum,
         expected, last);
 
+    if (use_hugepages) {
+      bench(
+          [&]() {
+            scancount<fastscancount::huge_vector<uint8_t>>(data_ptrs, answer, threshold);
+          },
+          "baseline scancount (huge pages)", unified, elapsed_huge, answer, sum,
+          expected, last);
+    }
+
     bench(
         [&]() {
           fastscancount::fastscancount(data_ptrs, answer, threshold);
         },
         "optimized cache-sensitive scancount", unified, elapsed_fast, answer, sum,
         expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_sorted(data_ptrs, answer, threshold);
+        },
+        "sorted-output scancount", unified, elapsed_sorted, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_specialized(data_ptrs, answer, threshold);
+        },
+        "specialized scancount", unified, elapsed_specialized, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_merge(data_ptrs, answer, threshold);
+        },
+        "merging scancount", unified, elapsed_merge, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_amac(data_ptrs, answer, threshold);
+        },
+        "interleaved unblocked scancount (AMAC)", unified, elapsed_amac, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_nibble(data_ptrs, answer, threshold);
+        },
+        "4-bit counter scancount", unified, elapsed_nibble, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          sort_then_fastscancount(unsorted_ptrs, sorted_copies, answer, threshold);
+        },
+        "sorting, then scancount (unsorted input)", unified, elapsed_sort_first, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_unsorted(unsorted_ptrs, answer, threshold);
+        },
+        "radix-partitioned scancount (unsorted input)", unified, elapsed_unsorted, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_prefetch(data_ptrs, answer, threshold, prefetch_distance);
+        },
+        "interleaved prefetching scancount", unified, elapsed_prefetch, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_windowed(windowed, query_elem, answer, threshold);
+        },
+        "window-major layout scancount", unified, elapsed_windowed, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_16bit(packed_ptrs, answer, threshold);
+        },
+        "16-bit packed scancount", unified, elapsed_16bit, answer, sum,
+        expected, last);
+#ifdef __AVX2__
+    bench(
+        [&]() {
+          fastscancount::fastscancount_16bit_avx2(packed_ptrs, answer, threshold);
+        },
+        "AVX2-based 16-bit packed scancount", unified, elapsed_16bit_avx, answer, sum,
+        expected, last);
+#endif
 #ifdef __AVX2__
     bench(
         [&]() {
           fastscancount::fastscancount_avx2(data_ptrs, answer, threshold);
         },
         "AVX2-based scancount", unified, elapsed_avx, answer, sum, expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_nibble_avx2(data_ptrs, answer, threshold);
+        },
+        "AVX2-based 4-bit counter scancount", unified, elapsed_nibble_avx, answer, sum, expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_bitmap(data_ptrs, hits, threshold);
+        },
+        "AVX2-based scancount (bitmap output)", unified, elapsed_bitmap, answer, sum, expected, last,
+        [&]() { return hits.cardinality(); });
 #endif
 #ifdef __AVX512F__
     bench(
@@ -236,37 +701,529 @@ void demo_data(const std::vector<std::vector<uint32_t>>& data,
         },
         "AVX512-based scancount", unified, elapsed_avx512, answer, sum, expected, last);
 #endif
+#ifdef __AVX2__
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx2(data_ptrs, answer, threshold);
+          remove_deleted(answer, deleted);
+        },
+        "AVX2-based scancount, then filtering deletions", unified, elapsed_filter_avx, answer, sum,
+        expected_live, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx2(data_ptrs, answer, threshold, &deleted);
+        },
+        "AVX2-based scancount (deletion mask)", unified, elapsed_masked_avx, answer, sum,
+        expected_live, last);
+#endif
+#ifdef __AVX512F__
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold);
+          remove_deleted(answer, deleted);
+        },
+        "AVX512-based scancount, then filtering deletions", unified, elapsed_filter_avx512, answer, sum,
+        expected_live, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold, &deleted);
+        },
+        "AVX512-based scancount (deletion mask)", unified, elapsed_masked_avx512, answer, sum,
+        expected_live, last);
+#endif
+    bench(
+        [&]() {
+          boolean_scancount(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+        },
+        "boolean scancount (separate passes)", unified, elapsed_boolean_ref, answer, sum,
+        expected_boolean, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_boolean(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+        },
+        "boolean scancount (fused masks)", unified, elapsed_boolean, answer, sum,
+        expected_boolean, last);
   }
   std::cout << "Elems per millisecond:" << std::endl;
   std::cout << "scancount: " << (sum_total/(elapsed/1e3)) << std::endl; 
+  if (use_hugepages) {
+    std::cout << "scancount (huge pages): " << (sum_total/(elapsed_huge/1e3)) << std::endl; 
+  }
   std::cout << "fastscancount: " << (sum_total/(elapsed_fast/1e3)) << std::endl; 
+  std::cout << "fastscancount_specialized: " << (sum_total/(elapsed_specialized/1e3)) << std::endl; 
+  std::cout << "fastscancount_sorted: " << (sum_total/(elapsed_sorted/1e3)) << std::endl; 
+  std::cout << "fastscancount_merge: " << (sum_total/(elapsed_merge/1e3)) << std::endl; 
+  std::cout << "fastscancount_amac: " << (sum_total/(elapsed_amac/1e3)) << std::endl; 
+  std::cout << "fastscancount_nibble: " << (sum_total/(elapsed_nibble/1e3)) << std::endl; 
+  std::cout << "sort, then fastscancount (unsorted input): " << (sum_total/(elapsed_sort_first/1e3)) << std::endl; 
+  std::cout << "fastscancount_unsorted: " << (sum_total/(elapsed_unsorted/1e3)) << std::endl; 
+  std::cout << "fastscancount_estimate: " << (sum_total/(elapsed_estimate/1e3))
+            << " (within the 95% bounds for " << estimates_within << " of " << queries.size()
+            << " queries, mean relative error " << estimate_error / std::max<size_t>(queries.size(), 1)
+            << ")" << std::endl; 
+  std::cout << "fastscancount_prefetch: " << (sum_total/(elapsed_prefetch/1e3)) << std::endl; 
+  std::cout << "fastscancount_windowed: " << (sum_total/(elapsed_windowed/1e3)) << std::endl; 
+  std::cout << "fastscancount_16bit: " << (sum_total/(elapsed_16bit/1e3)) << std::endl; 
+#ifdef __AVX2__
+  std::cout << "fastscancount_16bit_avx2: " << (sum_total/(elapsed_16bit_avx/1e3)) << std::endl; 
+#endif
 #ifdef __AVX2__
   std::cout << "fastscancount_avx2: " << (sum_total/(elapsed_avx/1e3)) << std::endl; 
+  std::cout << "fastscancount_nibble_avx2: " << (sum_total/(elapsed_nibble_avx/1e3)) << std::endl; 
+  std::cout << "fastscancount_bitmap: " << (sum_total/(elapsed_bitmap/1e3)) << std::endl; 
 #endif
 #ifdef __AVX512F__
   std::cout << "fastscancount_avx512: " << (sum_total/(elapsed_avx512/1e3)) << std::endl; 
 #endif
-
+#ifdef __AVX2__
+  std::cout << "fastscancount_avx2, then filtering deletions: " << (sum_total/(elapsed_filter_avx/1e3)) << std::endl; 
+  std::cout << "fastscancount_avx2 (deletion mask): " << (sum_total/(elapsed_masked_avx/1e3)) << std::endl; 
+#endif
+#ifdef __AVX512F__
+  std::cout << "fastscancount_avx512, then filtering deletions: " << (sum_total/(elapsed_filter_avx512/1e3)) << std::endl; 
+  std::cout << "fastscancount_avx512 (deletion mask): " << (sum_total/(elapsed_masked_avx512/1e3)) << std::endl; 
+#endif
+  std::cout << "boolean scancount (separate passes): " << (sum_total/(elapsed_boolean_ref/1e3)) << std::endl; 
+  std::cout << "fastscancount_boolean: " << (sum_total/(elapsed_boolean/1e3)) << std::endl; 
 }
 
 
-void demo_random(size_t N, size_t length, size_t array_count, size_t threshold) {
-  std::vector<std::vector<uint32_t>> data(array_count);
-
+// Replays the query log through a result_cache: repeated queries are served
+// from the cache, the others are computed with fastscancount and inserted.
+void demo_cache(const std::vector<std::vector<uint32_t>>& data,
+                const std::vector<std::vector<uint32_t>>& queries,
+                size_t threshold, size_t cache_bytes) {
+  fastscancount::result_cache cache(cache_bytes);
   std::vector<const std::vector<uint32_t>*> data_ptrs;
   std::vector<uint32_t> answer;
-  answer.reserve(N);
-
-  size_t sum = 0;
-  for (size_t c = 0; c < array_count; c++) {
-    std::vector<uint32_t> &v = data[c];
-    for (size_t i = 0; i < length; i++) {
-      v.push_back(rand() % N);
+  uint64_t hit_time = 0, miss_time = 0;
+  for (size_t qid = 0; qid < queries.size(); ++qid) {
+    const auto& query_elem = queries[qid];
+    WallClockTimer tm;
+    const std::vector<uint32_t> *cached = cache.find(query_elem, threshold);
+    if (cached != nullptr) {
+      hit_time += tm.split();
+#ifdef RUNNINGTESTS
+      data_ptrs.clear();
+      for (uint32_t idx : query_elem) {
+        data_ptrs.push_back(&data[idx]);
+      }
+      scancount(data_ptrs, answer, threshold);
+      auto a(*cached);
+      std::sort(a.begin(), a.end());
+      if (a != answer) {
+        throw std::runtime_error("bug: result_cache");
+      }
+#endif
+      continue;
     }
-    std::sort(v.begin(), v.end());
-    v.resize(std::distance(v.begin(), unique(v.begin(), v.end())));
-    sum += v.size();
-    data_ptrs.push_back(&data[c]);
+    data_ptrs.clear();
+    for (uint32_t idx : query_elem) {
+      if (idx >= data.size()) {
+        std::stringstream err;
+        err << "Inconsistent data, posting " << idx << 
+               " is >= # of postings " << data.size() << " query id " << qid;
+        throw std::runtime_error(err.str());
+      }
+      data_ptrs.push_back(&data[idx]);
+    }
+    fastscancount::fastscancount(data_ptrs, answer, threshold);
+    cache.insert(query_elem, threshold, answer);
+    miss_time += tm.split();
+  }
+  size_t hits = cache.hit_count(), misses = cache.miss_count();
+  std::cout << "Result cache (" << cache_bytes / (1024 * 1024) << " MB):" << std::endl;
+  std::cout << "hit rate: " << cache.hit_rate() * 100 << "% (" << hits
+            << " hits, " << misses << " misses)" << std::endl;
+  std::cout << "cached entries: " << cache.size() << " using "
+            << cache.bytes() << " bytes" << std::endl;
+  std::cout << "mean latency on hits: " << (hits ? double(hit_time) / hits : 0)
+            << " us" << std::endl;
+  std::cout << "mean latency on misses: " << (misses ? double(miss_time) / misses : 0)
+            << " us" << std::endl;
+  std::cout << "mean latency: " << double(hit_time + miss_time) / std::max<size_t>(1, queries.size())
+            << " us" << std::endl;
+}
+
+// a kernel as seen by the replay: query id in, hits out
+typedef std::function<void(size_t, std::vector<uint32_t>&)> replay_kernel;
+
+// nearest-rank percentile of sorted latencies
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+  size_t rank = size_t(std::ceil(p / 100 * sorted.size()));
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Replays the query log against each kernel and reports the latency
+// distribution. With replay_qps > 0, queries arrive open-loop at that average
+// rate (exponential inter-arrival times) and the latency of a query counts
+// from its arrival, so that the time it waits for a free client is included.
+// With replay_qps == 0, each client issues its next query as soon as the
+// previous one is done and the latency is the service time.
+void demo_replay(const std::vector<std::vector<uint32_t>>& data,
+                 const std::vector<std::vector<uint32_t>>& queries,
+                 size_t threshold) {
+  typedef std::chrono::steady_clock clock;
+  std::vector<std::vector<const std::vector<uint32_t>*>> query_ptrs(queries.size());
+  for (size_t qid = 0; qid < queries.size(); ++qid) {
+    for (uint32_t idx : queries[qid]) {
+      if (idx >= data.size()) {
+        std::stringstream err;
+        err << "Inconsistent data, posting " << idx << 
+               " is >= # of postings " << data.size() << " query id " << qid;
+        throw std::runtime_error(err.str());
+      }
+      query_ptrs[qid].push_back(&data[idx]);
+    }
+  }
+#ifdef __AVX512F__
+  std::vector<std::vector<uint32_t>> range_boundaries;
+  calc_alldata_boundaries(data, range_boundaries, range_size_avx512);
+  std::vector<std::vector<const std::vector<uint32_t>*>> query_ranges(queries.size());
+  for (size_t qid = 0; qid < queries.size(); ++qid) {
+    for (uint32_t idx : queries[qid]) {
+      query_ranges[qid].push_back(&range_boundaries[idx]);
+    }
+  }
+#endif
+  const uint8_t t8 = uint8_t(threshold);
+  std::vector<std::pair<std::string, replay_kernel>> kernels = {
+    {"scancount", [&](size_t qid, std::vector<uint32_t>& out) {
+      scancount(query_ptrs[qid], out, threshold); }},
+    {"fastscancount", [&](size_t qid, std::vector<uint32_t>& out) {
+      fastscancount::fastscancount(query_ptrs[qid], out, t8); }},
+    {"fastscancount_specialized", [&](size_t qid, std::vector<uint32_t>& out) {
+      fastscancount::fastscancount_specialized(query_ptrs[qid], out, t8); }},
+    {"fastscancount_sorted", [&](size_t qid, std::vector<uint32_t>& out) {
+      fastscancount::fastscancount_sorted(query_ptrs[qid], out, t8); }},
+    {"fastscancount_merge", [&](size_t qid, std::vector<uint32_t>& out) {
+      fastscancount::fastscancount_merge(query_ptrs[qid], out, t8); }},
+#ifdef __AVX2__
+    {"fastscancount_avx2", [&](size_t qid, std::vector<uint32_t>& out) {
+      fastscancount::fastscancount_avx2(query_ptrs[qid], out, t8); }},
+#endif
+  };
+#ifdef __AVX512F__
+  kernels.emplace_back("fastscancount_avx512", [&](size_t qid, std::vector<uint32_t>& out) {
+    fastscancount::fastscancount_avx512(range_size_avx512, query_ptrs[qid], query_ranges[qid], out, t8); });
+#endif
+
+  // the same arrival schedule for every kernel
+  const size_t n = queries.size();
+  std::vector<uint64_t> arrival(n, 0); // ns after the start
+  if (replay_qps > 0) {
+    std::mt19937_64 gen(1234);
+    std::exponential_distribution<double> gap(replay_qps / 1e9);
+    double t = 0;
+    for (size_t i = 0; i < n; i++) {
+      arrival[i] = uint64_t(t);
+      t += gap(gen);
+    }
+  }
+  std::ofstream dist;
+  if (!latency_file.empty()) {
+    dist.open(latency_file);
+    if (!dist) {
+      throw std::runtime_error("cannot write " + latency_file);
+    }
+    dist << "kernel,qid,arrival_us,latency_us\n";
+  }
+  std::cout << "replaying " << n << " queries with " << replay_clients << " client(s), ";
+  if (replay_qps > 0) {
+    std::cout << "open loop at " << replay_qps << " queries per second";
+  } else {
+    std::cout << "closed loop";
+  }
+  std::cout << std::endl;
+  std::cout << "latency in us: kernel p50 p90 p99 p99.9 max (achieved qps)" << std::endl;
+  for (const auto& k : kernels) {
+    std::vector<uint64_t> latency(n);
+    std::atomic<size_t> next(0);
+    std::exception_ptr failure; // the first client to fail, rethrown after the join
+    std::mutex failure_mutex;
+    const clock::time_point start = clock::now();
+    auto client = [&]() {
+      try {
+        std::vector<uint32_t> answer;
+        for (size_t i; (i = next++) < n;) {
+          clock::time_point arrived = start + std::chrono::nanoseconds(arrival[i]);
+          if (replay_qps > 0) {
+            std::this_thread::sleep_until(arrived);
+          } else {
+            arrived = clock::now();
+          }
+          k.second(i, answer);
+          latency[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              clock::now() - arrived).count();
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(failure_mutex);
+        if (!failure) {
+          failure = std::current_exception();
+        }
+        next = n; // the other clients stop after their current query
+      }
+    };
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < replay_clients; c++) {
+      clients.emplace_back(client);
+    }
+    for (auto& c : clients) {
+      c.join();
+    }
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+    const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    if (dist.is_open()) {
+      for (size_t i = 0; i < n; i++) {
+        dist << k.first << "," << i << "," << arrival[i] / 1e3 << "," << latency[i] / 1e3 << "\n";
+      }
+    }
+    std::vector<uint64_t> sorted(latency);
+    std::sort(sorted.begin(), sorted.end());
+    if (sorted.empty()) {
+      continue;
+    }
+    std::cout << k.first << " " << percentile(sorted, 50) / 1e3 << " "
+              << percentile(sorted, 90) / 1e3 << " " << percentile(sorted, 99) / 1e3
+              << " " << percentile(sorted, 99.9) / 1e3 << " " << sorted.back() / 1e3
+              << " (" << n / seconds << ")" << std::endl;
+  }
+  if (dist.is_open()) {
+    std::cout << "wrote the latency distribution to " << latency_file << std::endl;
+  }
+}
+
+// Publishes the postings in shared memory and serves the queries from one
+// worker process per shard, against fastscancount in this process.
+void demo_shards(const std::vector<std::vector<uint32_t>>& data,
+                 const std::vector<std::vector<uint32_t>>& queries,
+                 size_t threshold, uint32_t shards) {
+  const std::string name = "/fastscancount." + std::to_string(getpid());
+  fastscancount::shared_index::publish(name, data, shards);
+  std::vector<uint32_t> answer;
+  std::vector<const std::vector<uint32_t>*> data_ptrs;
+  size_t sum_total = 0;
+  uint64_t elapsed_local = 0, elapsed_shards = 0;
+  try {
+    fastscancount::shard_pool pool(name);
+    std::cout << "published " << fastscancount::shared_index(name).bytes()
+              << " bytes as " << name << ", serving with " << pool.size()
+              << " worker processes" << std::endl;
+    for (size_t qid = 0; qid < queries.size(); ++qid) {
+      const auto& query_elem = queries[qid];
+      data_ptrs.clear();
+      size_t sum = 0;
+      for (uint32_t idx : query_elem) {
+        if (idx >= data.size()) {
+          std::stringstream err;
+          err << "Inconsistent data, posting " << idx << 
+                 " is >= # of postings " << data.size() << " query id " << qid;
+          throw std::runtime_error(err.str());
+        }
+        sum += data[idx].size();
+        data_ptrs.push_back(&data[idx]);
+      }
+      sum_total += sum;
+      WallClockTimer tm;
+      fastscancount::fastscancount(data_ptrs, answer, threshold);
+      elapsed_local += tm.split();
+      tm.reset();
+      pool.query(query_elem, answer, threshold);
+      elapsed_shards += tm.split();
+#ifdef RUNNINGTESTS
+      test(
+        [&](){
+          pool.query(query_elem, answer, threshold);
+        }, data_ptrs, answer, threshold, "shard_pool"
+      );
+#endif
+    }
+  } catch (...) {
+    fastscancount::shared_index::unlink(name);
+    throw;
+  }
+  fastscancount::shared_index::unlink(name);
+  std::cout << "Elems per millisecond:" << std::endl;
+  std::cout << "fastscancount (this process): " << (sum_total/(elapsed_local/1e3)) << std::endl; 
+  std::cout << "fastscancount_shard (" << shards << " processes): " << (sum_total/(elapsed_shards/1e3)) << std::endl; 
+}
+
+// Rebuilds the postings document by document into a segmented index, with
+// compaction running in the background, then queries it.
+void demo_segmented(const std::vector<std::vector<uint32_t>>& data,
+                    const std::vector<std::vector<uint32_t>>& queries,
+                    size_t threshold) {
+  size_t total = 0;
+  for (const auto& v : data) {
+    total += v.size();
+  }
+  // about 32 sealed segments, merged down to 4
+  fastscancount::segmented_index index(data.size(), total / 32 + 1, 4);
+  // visit the documents in increasing order: a k-way merge of the lists
+  typedef std::pair<uint32_t, uint32_t> doc_term;
+  std::priority_queue<doc_term, std::vector<doc_term>, std::greater<doc_term>> heap;
+  std::vector<size_t> pos(data.size());
+  for (uint32_t t = 0; t < data.size(); t++) {
+    if (!data[t].empty()) {
+      heap.push({data[t][0], t});
+    }
+  }
+  std::vector<uint32_t> terms;
+  size_t documents = 0;
+  WallClockTimer tm;
+  while (!heap.empty()) {
+    const uint32_t doc = heap.top().first;
+    terms.clear();
+    while (!heap.empty() && heap.top().first == doc) {
+      const uint32_t t = heap.top().second;
+      heap.pop();
+      terms.push_back(t);
+      if (++pos[t] < data[t].size()) {
+        heap.push({data[t][pos[t]], t});
+      }
+    }
+    index.add_document(doc, terms);
+    documents++;
+  }
+  const uint64_t ingest_time = tm.split();
+  std::cout << "added " << documents << " documents in " << ingest_time << " us, "
+            << index.merge_count() << " merges so far, " << index.segment_count()
+            << " segments (+ mutable)" << std::endl;
+
+  std::vector<uint32_t> answer;
+  std::vector<const std::vector<uint32_t>*> data_ptrs;
+  fastscancount::segmented_index::query_lists q;
+  size_t sum_total = 0, slices = 0;
+  uint64_t elapsed_segmented = 0, elapsed_fast = 0;
+  for (size_t qid = 0; qid < queries.size(); ++qid) {
+    const auto& query_elem = queries[qid];
+    data_ptrs.clear();
+    size_t sum = 0;
+    for (uint32_t idx : query_elem) {
+      if (idx >= data.size()) {
+        std::stringstream err;
+        err << "Inconsistent data, posting " << idx << 
+               " is >= # of postings " << data.size() << " query id " << qid;
+        throw std::runtime_error(err.str());
+      }
+      sum += data[idx].size();
+      data_ptrs.push_back(&data[idx]);
+    }
+    sum_total += sum;
+    index.lists_for(query_elem, q);
+    slices += q.lists.size();
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_segmented(index, query_elem, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_segmented"
+    );
+#endif
+    tm.reset();
+    fastscancount::fastscancount(data_ptrs, answer, threshold);
+    elapsed_fast += tm.split();
+    tm.reset();
+    fastscancount::fastscancount_segmented(index, query_elem, answer, threshold);
+    elapsed_segmented += tm.split();
+  }
+  std::cout << "average slices per query: " << double(slices) / std::max<size_t>(queries.size(), 1)
+            << ", segments: " << index.segment_count() << std::endl;
+  std::cout << "Elems per millisecond:" << std::endl;
+  std::cout << "fastscancount (one list per term): " << (sum_total/(elapsed_fast/1e3)) << std::endl; 
+  std::cout << "fastscancount_segmented: " << (sum_total/(elapsed_segmented/1e3)) << std::endl; 
+}
+
+// Out-of-core mode: the postings are never loaded as a whole.
+void demo_stream(const std::string& postings_file,
+                 const std::vector<std::vector<uint32_t>>& queries,
+                 size_t threshold) {
+  fastscancount::posting_file file(postings_file);
+  std::unique_ptr<fastscancount::async_reader> reader;
+  if (pread_threads > 0) {
+    reader.reset(new fastscancount::pread_pool_reader(pread_threads));
+  } else {
+    reader = fastscancount::make_async_reader();
+  }
+  std::cout << "streaming from " << postings_file << " with " << reader->name();
+  if (drop_page_cache) {
+    std::cout << ", dropping the page cache before each query";
+  }
+  std::cout << std::endl;
+
+  std::vector<uint32_t> answer;
+  size_t sum_total = 0;
+  uint64_t elapsed = 0;
+  for (size_t qid = 0; qid < queries.size(); ++qid) {
+    const auto& query_elem = queries[qid];
+    size_t sum = 0;
+    for (uint32_t idx : query_elem) {
+      if (idx >= file.list_count()) {
+        std::stringstream err;
+        err << "Inconsistent data, posting " << idx << 
+               " is >= # of postings " << file.list_count() << " query id " << qid;
+        throw std::runtime_error(err.str());
+      }
+      sum += file.list_size(idx);
+    }
+    sum_total += sum;
+    if (drop_page_cache) {
+      file.drop_cache();
+    }
+    WallClockTimer tm;
+    fastscancount::fastscancount_stream(file, query_elem, answer, threshold, *reader);
+    uint64_t t = tm.split();
+    elapsed += t;
+    std::cout << "Qid: " << qid << " got " << answer.size() << " hits in " << t << " us\n";
+#ifdef RUNNINGTESTS
+    // only the lists of this query are loaded
+    std::vector<std::vector<uint32_t>> lists(query_elem.size());
+    std::vector<const std::vector<uint32_t>*> data_ptrs;
+    for (size_t i = 0; i < query_elem.size(); i++) {
+      file.read_list(query_elem[i], lists[i]);
+      if (!lists[i].empty()) {
+        data_ptrs.push_back(&lists[i]);
+      }
+    }
+    if (!data_ptrs.empty()) {
+      test(
+        [&](){
+          fastscancount::fastscancount_stream(file, query_elem, answer, threshold, *reader);
+        }, data_ptrs, answer, threshold, "fastscancount_stream"
+      );
+    }
+#endif
+  }
+  std::cout << "Elems per millisecond:" << std::endl;
+  std::cout << "fastscancount_stream: " << (sum_total/(elapsed/1e3)) << std::endl; 
+  std::cout << "MB of postings per second: " << (sum_total * 4.0 / elapsed) << std::endl;
+}
+
+void demo_random(size_t N, size_t length, size_t array_count, size_t threshold) {
+  std::vector<std::vector<uint32_t>> data(array_count);
+
+  std::vector<const std::vector<uint32_t>*> data_ptrs;
+  std::vector<uint32_t> answer;
+  if (use_hugepages) {
+    fastscancount::reserve_hugepages(answer, N);
+  } else {
+    answer.reserve(N);
+  }
+
+  size_t sum = 0;
+  for (size_t c = 0; c < array_count; c++) {
+    std::vector<uint32_t> &v = data[c];
+    if (use_hugepages) {
+      fastscancount::reserve_hugepages(v, length);
+    }
+    for (size_t i = 0; i < length; i++) {
+      v.push_back(rand() % N);
+    }
+    std::sort(v.begin(), v.end());
+    v.resize(std::distance(v.begin(), unique(v.begin(), v.end())));
+    sum += v.size();
+    data_ptrs.push_back(&data[c]);
   }
 
 
@@ -286,8 +1243,14 @@ void demo_random(size_t N, size_t length, size_t array_count, size_t threshold)
                            PERF_COUNT_HW_CACHE_MISSES
 #endif
                           };
-  LinuxEventsWrapper unified(evts);
-  float elapsed = 0, elapsed_fast = 0, elapsed_avx = 0, elapsed_avx512 = 0;
+  std::vector<int> cache_evts;
+#ifdef __linux__
+  if (use_hugepages) {
+    cache_evts.push_back(cache_read_miss_event(PERF_COUNT_HW_CACHE_DTLB));
+  }
+#endif
+  LinuxEventsWrapper unified(evts, cache_evts);
+  float elapsed = 0, elapsed_huge = 0, elapsed_fast = 0, elapsed_sorted = 0, elapsed_prefetch = 0, elapsed_avx = 0, elapsed_avx512 = 0;
   scancount(data_ptrs, answer, threshold);
   const size_t expected = answer.size();
   std::cout << "Got " << expected << " hits\n";
@@ -303,6 +1266,38 @@ void demo_random(size_t N, size_t length, size_t array_count, size_t threshold)
         expected, last);
   }
 
+  for (size_t t = 0; t < REPEATS && use_hugepages; t++) {
+    bool last = (t == REPEATS - 1);
+
+    bench(
+        [&]() {
+          scancount<fastscancount::huge_vector<uint8_t>>(data_ptrs, answer, threshold);
+        },
+        "baseline scancount (huge pages)", unified, elapsed_huge, answer, sum,
+        expected, last);
+  }
+
+  // the same universe-sized counters, with the misses overlapped
+  float elapsed_amac = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_amac(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_amac"
+    );
+#endif
+
+    bench(
+        [&]() {
+          fastscancount::fastscancount_amac(data_ptrs, answer, threshold);
+        },
+        "interleaved unblocked scancount (AMAC)", unified, elapsed_amac, answer, sum,
+        expected, last);
+  }
+
   for (size_t t = 0; t < REPEATS; t++) {
     bool last = (t == REPEATS - 1);
 
@@ -322,6 +1317,233 @@ void demo_random(size_t N, size_t length, size_t array_count, size_t threshold)
         expected, last);
   }
 
+  float elapsed_specialized = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_specialized(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_specialized"
+    );
+#endif
+
+    bench(
+        [&]() {
+          fastscancount::fastscancount_specialized(data_ptrs, answer, threshold);
+        },
+        "specialized scancount", unified, elapsed_specialized, answer, sum,
+        expected, last);
+  }
+
+  {
+    // with few lists, the number of lists is a template parameter as well,
+    // and merging the lists needs no counters at all
+    std::vector<const std::vector<uint32_t>*> few_ptrs(data_ptrs.begin(),
+        data_ptrs.begin() + std::min<size_t>(8, data_ptrs.size()));
+    size_t few_sum = 0;
+    for (auto p : few_ptrs) {
+      few_sum += p->size();
+    }
+    scancount(few_ptrs, answer, threshold);
+    const size_t few_expected = answer.size();
+    float elapsed_few = 0, elapsed_few_specialized = 0, elapsed_few_merge = 0;
+    for (size_t t = 0; t < REPEATS; t++) {
+      bool last = (t == REPEATS - 1);
+#ifdef RUNNINGTESTS
+      test(
+        [&](){
+          fastscancount::fastscancount_specialized(few_ptrs, answer, threshold);
+        }, few_ptrs, answer, threshold, "fastscancount_specialized (few lists)"
+      );
+      test(
+        [&](){
+          fastscancount::fastscancount_merge(few_ptrs, answer, threshold);
+        }, few_ptrs, answer, threshold, "fastscancount_merge (few lists)", true
+      );
+#endif
+      bench(
+          [&]() {
+            fastscancount::fastscancount(few_ptrs, answer, threshold);
+          },
+          "optimized cache-sensitive scancount (8 lists)", unified, elapsed_few, answer, few_sum,
+          few_expected, last);
+      bench(
+          [&]() {
+            fastscancount::fastscancount_specialized(few_ptrs, answer, threshold);
+          },
+          "specialized scancount (8 lists)", unified, elapsed_few_specialized, answer, few_sum,
+          few_expected, last);
+      bench(
+          [&]() {
+            fastscancount::fastscancount_merge(few_ptrs, answer, threshold);
+          },
+          "merging scancount (8 lists)", unified, elapsed_few_merge, answer, few_sum,
+          few_expected, last);
+    }
+    std::cout << "8 lists, elems per millisecond: fastscancount: "
+              << (few_sum * REPEATS / (elapsed_few / 1e3))
+              << " fastscancount_specialized: "
+              << (few_sum * REPEATS / (elapsed_few_specialized / 1e3))
+              << " fastscancount_merge: "
+              << (few_sum * REPEATS / (elapsed_few_merge / 1e3)) << std::endl;
+  }
+
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_sorted(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_sorted", true
+    );
+#endif
+
+    bench(
+        [&]() {
+          fastscancount::fastscancount_sorted(data_ptrs, answer, threshold);
+        },
+        "sorted-output scancount", unified, elapsed_sorted, answer, sum,
+        expected, last);
+  }
+
+  std::vector<std::vector<uint32_t>> shuffled(data), sorted_copies;
+  std::vector<const std::vector<uint32_t>*> unsorted_ptrs;
+  std::mt19937 gen(1234);
+  for (auto& v : shuffled) {
+    std::shuffle(v.begin(), v.end(), gen);
+    unsorted_ptrs.push_back(&v);
+  }
+  float elapsed_unsorted = 0, elapsed_sort_first = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_unsorted(unsorted_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_unsorted"
+    );
+#endif
+
+    bench(
+        [&]() {
+          sort_then_fastscancount(unsorted_ptrs, sorted_copies, answer, threshold);
+        },
+        "sorting, then scancount (unsorted input)", unified, elapsed_sort_first, answer, sum,
+        expected, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_unsorted(unsorted_ptrs, answer, threshold);
+        },
+        "radix-partitioned scancount (unsorted input)", unified, elapsed_unsorted, answer, sum,
+        expected, last);
+  }
+
+  float elapsed_estimate = 0;
+  fastscancount::hit_estimate estimate;
+  for (size_t t = 0; t < REPEATS; t++) {
+    WallClockTimer tm;
+    estimate = fastscancount::fastscancount_estimate(data_ptrs, threshold, 1.0 / 32, 4096, t);
+    elapsed_estimate += tm.split();
+  }
+  std::cout << "estimated " << estimate.hits << " hits in [" << estimate.low << ", "
+            << estimate.high << "] from " << estimate.sampled << " of " << estimate.windows
+            << " windows, actual " << expected << std::endl;
+
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_prefetch(data_ptrs, answer, threshold, prefetch_distance);
+      }, data_ptrs, answer, threshold, "fastscancount_prefetch"
+    );
+#endif
+
+    bench(
+        [&]() {
+          fastscancount::fastscancount_prefetch(data_ptrs, answer, threshold, prefetch_distance);
+        },
+        "interleaved prefetching scancount", unified, elapsed_prefetch, answer, sum,
+        expected, last);
+  }
+
+  fastscancount::windowed_index windowed;
+  fastscancount::build_windowed_index(data, windowed);
+  std::vector<uint32_t> all_lists(array_count);
+  for (size_t c = 0; c < array_count; c++) {
+    all_lists[c] = c;
+  }
+  float elapsed_windowed = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_windowed(windowed, all_lists, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_windowed"
+    );
+#endif
+
+    bench(
+        [&]() {
+          fastscancount::fastscancount_windowed(windowed, all_lists, answer, threshold);
+        },
+        "window-major layout scancount", unified, elapsed_windowed, answer, sum,
+        expected, last);
+  }
+
+  std::vector<std::vector<uint16_t>> packed(array_count);
+  std::vector<const std::vector<uint16_t>*> packed_ptrs;
+  for (size_t c = 0; c < array_count; c++) {
+    fastscancount::pack16(data[c], packed[c]);
+    packed_ptrs.push_back(&packed[c]);
+  }
+  float elapsed_16bit = 0, elapsed_16bit_avx = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_16bit(packed_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_16bit"
+    );
+#endif
+
+    bench(
+        [&]() {
+          fastscancount::fastscancount_16bit(packed_ptrs, answer, threshold);
+        },
+        "16-bit packed scancount", unified, elapsed_16bit, answer, sum,
+        expected, last);
+  }
+#ifdef __AVX2__
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_16bit_avx2(packed_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_16bit_avx2", true
+    );
+#endif
+
+    bench(
+        [&]() {
+          fastscancount::fastscancount_16bit_avx2(packed_ptrs, answer, threshold);
+        },
+        "AVX2-based 16-bit packed scancount", unified, elapsed_16bit_avx, answer, sum,
+        expected, last);
+  }
+#endif
+
   for (size_t t = 0; t < REPEATS; t++) {
     bool last = (t == REPEATS - 1);
 
@@ -330,7 +1552,7 @@ void demo_random(size_t N, size_t length, size_t array_count, size_t threshold)
     test(
       [&](){
         fastscancount::fastscancount_avx2(data_ptrs, answer, threshold);
-      }, data_ptrs, answer, threshold, "fastscancount_avx2"
+      }, data_ptrs, answer, threshold, "fastscancount_avx2", true
     );
 #endif
     bench(
@@ -341,6 +1563,113 @@ void demo_random(size_t N, size_t length, size_t array_count, size_t threshold)
 #endif
   }
 
+  // 4-bit counters against the byte counters above
+  float elapsed_nibble = 0, elapsed_nibble_avx = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_nibble(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_nibble"
+    );
+#ifdef __AVX2__
+    test(
+      [&](){
+        fastscancount::fastscancount_nibble_avx2(data_ptrs, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_nibble_avx2", true
+    );
+#endif
+#endif
+    bench(
+        [&]() {
+          fastscancount::fastscancount_nibble(data_ptrs, answer, threshold);
+        },
+        "4-bit counter scancount", unified, elapsed_nibble, answer, sum, expected, last);
+#ifdef __AVX2__
+    bench(
+        [&]() {
+          fastscancount::fastscancount_nibble_avx2(data_ptrs, answer, threshold);
+        },
+        "AVX2-based 4-bit counter scancount", unified, elapsed_nibble_avx, answer, sum, expected, last);
+#endif
+  }
+
+#ifdef __AVX2__
+  // one pass for all the thresholds that main() iterates over
+  std::vector<uint64_t> histogram;
+  std::vector<std::vector<uint32_t>> outs;
+  float elapsed_histogram = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+#ifdef RUNNINGTESTS
+    test_histogram(data_ptrs, answer, threshold);
+#endif
+    bench(
+        [&]() {
+          fastscancount::fastscancount_histogram(data_ptrs, histogram, {uint8_t(threshold)}, outs);
+          answer.swap(outs[0]);
+        },
+        "AVX2-based count histogram (all thresholds)", unified, elapsed_histogram, answer, sum, expected, last);
+  }
+  if (threshold == 1) {
+    std::cout << "hits per threshold:";
+    for (size_t k = 1; k < 10; k++) {
+      uint64_t hits_above = 0;
+      for (size_t j = k + 1; j < histogram.size(); j++)
+        hits_above += histogram[j];
+      std::cout << " " << k << ":" << hits_above;
+    }
+    std::cout << std::endl;
+  }
+
+  // the first 20 lists are materialized as a group at "index time"
+  const size_t group_size = std::min<size_t>(20, data_ptrs.size());
+  std::vector<const std::vector<uint32_t>*> members(data_ptrs.begin(), data_ptrs.begin() + group_size);
+  std::vector<const std::vector<uint32_t>*> rest(data_ptrs.begin() + group_size, data_ptrs.end());
+  fastscancount::materialized_group group;
+  fastscancount::materialize_group(members, group);
+  float elapsed_groups = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_groups({&group}, rest, answer, threshold);
+      }, data_ptrs, answer, threshold, "fastscancount_groups", true
+    );
+#endif
+    bench(
+        [&]() {
+          fastscancount::fastscancount_groups({&group}, rest, answer, threshold);
+        },
+        "AVX2-based scancount (20 lists materialized)", unified, elapsed_groups, answer, sum, expected, last);
+  }
+  std::cout << "materialized group: " << group.windows.size() << " windows, "
+            << group.bytes() << " bytes" << std::endl;
+
+  fastscancount::hit_set hits;
+  float elapsed_bitmap = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+#ifdef RUNNINGTESTS
+    test(
+      [&](){
+        fastscancount::fastscancount_bitmap(data_ptrs, hits, threshold);
+        hits.to_vector(answer);
+      }, data_ptrs, answer, threshold, "fastscancount_bitmap", true
+    );
+#endif
+    bench(
+        [&]() {
+          fastscancount::fastscancount_bitmap(data_ptrs, hits, threshold);
+        },
+        "AVX2-based scancount (bitmap output)", unified, elapsed_bitmap, answer, sum, expected, last,
+        [&]() { return hits.cardinality(); });
+  }
+#endif
+
   for (size_t t = 0; t < REPEATS; t++) {
     bool last = (t == REPEATS - 1);
 #ifdef __AVX512F__
@@ -348,7 +1677,7 @@ void demo_random(size_t N, size_t length, size_t array_count, size_t threshold)
     test(
       [&](){
         fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold);
-      }, data_ptrs, answer, threshold, "fastscancount_avx512"
+      }, data_ptrs, answer, threshold, "fastscancount_avx512", true
     );
 #endif
 
@@ -360,57 +1689,247 @@ void demo_random(size_t N, size_t length, size_t array_count, size_t threshold)
 #endif
   }
 
+  std::vector<const std::vector<uint32_t>*> required_ptrs, excluded_ptrs, optional_ptrs;
+  split_boolean_query(data_ptrs, required_ptrs, excluded_ptrs, optional_ptrs);
+  boolean_scancount(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+  const size_t expected_boolean = answer.size();
+  float elapsed_boolean_ref = 0, elapsed_boolean = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+#ifdef RUNNINGTESTS
+    test_boolean(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+#endif
+    bench(
+        [&]() {
+          boolean_scancount(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+        },
+        "boolean scancount (separate passes)", unified, elapsed_boolean_ref, answer, sum,
+        expected_boolean, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_boolean(required_ptrs, excluded_ptrs, optional_ptrs, answer, threshold);
+        },
+        "boolean scancount (fused masks)", unified, elapsed_boolean, answer, sum,
+        expected_boolean, last);
+  }
+
+  // about one document in ten is deleted
+  const std::vector<uint64_t> deleted = random_deletions(N, 10);
+  scancount(data_ptrs, answer, threshold);
+  remove_deleted(answer, deleted);
+  const size_t expected_live = answer.size();
+  float elapsed_filter_avx = 0, elapsed_masked_avx = 0, elapsed_filter_avx512 = 0, elapsed_masked_avx512 = 0;
+  for (size_t t = 0; t < REPEATS; t++) {
+    bool last = (t == REPEATS - 1);
+#ifdef __AVX2__
+#ifdef RUNNINGTESTS
+    test_deleted(
+      [&](){
+        fastscancount::fastscancount_avx2(data_ptrs, answer, threshold, &deleted);
+      }, data_ptrs, deleted, answer, threshold, "fastscancount_avx2"
+    );
+#endif
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx2(data_ptrs, answer, threshold);
+          remove_deleted(answer, deleted);
+        },
+        "AVX2-based scancount, then filtering deletions", unified, elapsed_filter_avx, answer, sum,
+        expected_live, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx2(data_ptrs, answer, threshold, &deleted);
+        },
+        "AVX2-based scancount (deletion mask)", unified, elapsed_masked_avx, answer, sum,
+        expected_live, last);
+#endif
+#ifdef __AVX512F__
+#ifdef RUNNINGTESTS
+    test_deleted(
+      [&](){
+        fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold, &deleted);
+      }, data_ptrs, deleted, answer, threshold, "fastscancount_avx512"
+    );
+#endif
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold);
+          remove_deleted(answer, deleted);
+        },
+        "AVX512-based scancount, then filtering deletions", unified, elapsed_filter_avx512, answer, sum,
+        expected_live, last);
+    bench(
+        [&]() {
+          fastscancount::fastscancount_avx512(range_size_avx512, data_ptrs, range_ptrs, answer, threshold, &deleted);
+        },
+        "AVX512-based scancount (deletion mask)", unified, elapsed_masked_avx512, answer, sum,
+        expected_live, last);
+#endif
+  }
+
   std::cout << "Elems per millisecond:" << std::endl;
   std::cout << "scancount: " << (sum_total/(elapsed/1e3)) << std::endl; 
+  if (use_hugepages) {
+    std::cout << "scancount (huge pages): " << (sum_total/(elapsed_huge/1e3)) << std::endl; 
+  }
+  std::cout << "fastscancount_amac: " << (sum_total/(elapsed_amac/1e3)) << std::endl; 
   std::cout << "fastscancount: " << (sum_total/(elapsed_fast/1e3)) << std::endl; 
+  std::cout << "fastscancount_specialized: " << (sum_total/(elapsed_specialized/1e3)) << std::endl; 
+  std::cout << "fastscancount_sorted: " << (sum_total/(elapsed_sorted/1e3)) << std::endl; 
+  std::cout << "sort, then fastscancount (unsorted input): " << (sum_total/(elapsed_sort_first/1e3)) << std::endl; 
+  std::cout << "fastscancount_unsorted: " << (sum_total/(elapsed_unsorted/1e3)) << std::endl; 
+  std::cout << "fastscancount_estimate: " << (sum_total/(elapsed_estimate/1e3)) << std::endl; 
+  std::cout << "fastscancount_prefetch: " << (sum_total/(elapsed_prefetch/1e3)) << std::endl; 
+  std::cout << "fastscancount_windowed: " << (sum_total/(elapsed_windowed/1e3)) << std::endl; 
+  std::cout << "fastscancount_16bit: " << (sum_total/(elapsed_16bit/1e3)) << std::endl; 
+  std::cout << "fastscancount_nibble: " << (sum_total/(elapsed_nibble/1e3)) << std::endl; 
+#ifdef __AVX2__
+  std::cout << "fastscancount_16bit_avx2: " << (sum_total/(elapsed_16bit_avx/1e3)) << std::endl; 
+#endif
 #ifdef __AVX2__
   std::cout << "fastscancount_avx2: " << (sum_total/(elapsed_avx/1e3)) << std::endl; 
+  std::cout << "fastscancount_nibble_avx2: " << (sum_total/(elapsed_nibble_avx/1e3)) << std::endl; 
+  std::cout << "fastscancount_bitmap: " << (sum_total/(elapsed_bitmap/1e3)) << std::endl; 
+  std::cout << "fastscancount_histogram: " << (sum_total/(elapsed_histogram/1e3)) << std::endl; 
+  std::cout << "fastscancount_groups: " << (sum_total/(elapsed_groups/1e3)) << std::endl; 
 #endif
 #ifdef __AVX512F__
   std::cout << "fastscancount_avx512: " << (sum_total/(elapsed_avx512/1e3)) << std::endl; 
 #endif
+#ifdef __AVX2__
+  std::cout << "fastscancount_avx2, then filtering deletions: " << (sum_total/(elapsed_filter_avx/1e3)) << std::endl; 
+  std::cout << "fastscancount_avx2 (deletion mask): " << (sum_total/(elapsed_masked_avx/1e3)) << std::endl; 
+#endif
+#ifdef __AVX512F__
+  std::cout << "fastscancount_avx512, then filtering deletions: " << (sum_total/(elapsed_filter_avx512/1e3)) << std::endl; 
+  std::cout << "fastscancount_avx512 (deletion mask): " << (sum_total/(elapsed_masked_avx512/1e3)) << std::endl; 
+#endif
+  std::cout << "boolean scancount (separate passes): " << (sum_total/(elapsed_boolean_ref/1e3)) << std::endl; 
+  std::cout << "fastscancount_boolean: " << (sum_total/(elapsed_boolean/1e3)) << std::endl; 
+}
+
+// parses a decimal integer > 0, returns false on anything else
+bool parse_positive(const std::string& value, size_t& out) {
+  if (value.empty() || value[0] < '0' || value[0] > '9') {
+    return false;
+  }
+  size_t pos = 0;
+  unsigned long v = 0;
+  try {
+    v = std::stoul(value, &pos);
+  } catch (const std::logic_error&) {
+    return false;
+  }
+  if (pos != value.size() || v == 0) {
+    return false;
+  }
+  out = v;
+  return true;
 }
 
 void usage(const std::string& err="") {
   if (!err.empty()) {
     std::cerr << err << std::endl;
   }
-  std::cerr << "usage: --postings <postings file> --queries <queries file> --threshold <threshold>" << std::endl;
+  std::cerr << "usage: [--postings <postings file> --queries <queries file> --threshold <threshold>] [--hugepages] [--large] [--prefetch-distance <elements>] [--cache-mb <MB>]" << std::endl;
+  std::cerr << "       --postings <postings file> --queries <queries file> --threshold <threshold> --stream [--drop-cache] [--pread-threads <n>]" << std::endl;
+  std::cerr << "       --postings <postings file> --queries <queries file> --threshold <threshold> --shards <n>" << std::endl;
+  std::cerr << "       --postings <postings file> --queries <queries file> --threshold <threshold> --segmented" << std::endl;
+  std::cerr << "       --postings <postings file> --queries <queries file> --threshold <threshold> --replay [--qps <rate>] [--clients <n>] [--latency-out <csv file>]" << std::endl;
 }
 
 int main(int argc, char *argv[]) {
   // A very naive way to process arguments, 
   // but it's ok unless we need to extend it substantially.
-  if (argc != 1) {
-    if (argc != 7) {
-      usage("");
+  std::string postings_file, queries_file;
+  int threshold = -1;
+  bool large = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--hugepages") {
+      use_hugepages = true;
+      continue;
+    }
+    if (arg == "--large") {
+      large = true;
+      continue;
+    }
+    if (arg == "--stream") {
+      stream_mode = true;
+      continue;
+    }
+    if (arg == "--drop-cache") {
+      drop_page_cache = true;
+      continue;
+    }
+    if (arg == "--replay") {
+      replay_mode = true;
+      continue;
+    }
+    if (arg == "--segmented") {
+      segmented_mode = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      usage("Missing value for " + arg);
       return EXIT_FAILURE; 
     }
-    std::string postings_file, queries_file;
-    int threshold = -1;
-    for (int i = 1; i < argc; ++i) {
-      if (std::string(argv[i]) == "--postings") {
-        postings_file = argv[++i];
-      } else if (std::string(argv[i]) == "--queries") {
-        queries_file = argv[++i];
-      } else if (std::string(argv[i]) == "--threshold") {
-        threshold = std::atoi(argv[++i]);
+    if (arg == "--postings") {
+      postings_file = argv[++i];
+    } else if (arg == "--queries") {
+      queries_file = argv[++i];
+    } else if (arg == "--threshold") {
+      threshold = std::atoi(argv[++i]);
+    } else if (arg == "--shards") {
+      shard_count = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--qps") {
+      replay_qps = std::atof(argv[++i]);
+    } else if (arg == "--clients") {
+      replay_clients = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--latency-out") {
+      latency_file = argv[++i];
+    } else if (arg == "--pread-threads") {
+      if (!parse_positive(argv[++i], pread_threads) || pread_threads > 1024) {
+        usage("--pread-threads expects an integer between 1 and 1024");
+        return EXIT_FAILURE; 
       }
+    } else if (arg == "--cache-mb") {
+      // the capacity in bytes must fit in a size_t
+      if (!parse_positive(argv[++i], cache_mb) || cache_mb > SIZE_MAX / (1024 * 1024)) {
+        usage("--cache-mb expects a positive number of megabytes");
+        return EXIT_FAILURE; 
+      }
+    } else if (arg == "--prefetch-distance") {
+      if (!parse_positive(argv[++i], prefetch_distance)) {
+        usage("--prefetch-distance expects a positive integer");
+        return EXIT_FAILURE; 
+      }
+    } else {
+      usage("Unknown option: " + arg);
+      return EXIT_FAILURE; 
     }
+  }
+  if (!postings_file.empty() || !queries_file.empty() || threshold >= 0) {
     if (postings_file.empty() || queries_file.empty() || threshold < 0) {
       usage("Specify queries, postings, and the threshold!");
       return EXIT_FAILURE; 
     }
     std::vector<uint32_t> tmp; 
     std::vector<std::vector<uint32_t>> data;
-    {
+    if (!stream_mode) {
       MaropuGapReader drdr(postings_file);
       if (!drdr.open()) {
         usage("Cannot open: " + postings_file);
         return EXIT_FAILURE; 
       }
       while (drdr.loadIntegers(tmp)) {
-        data.push_back(tmp);
+        if (use_hugepages) {
+          data.emplace_back();
+          fastscancount::reserve_hugepages(data.back(), tmp.size());
+          data.back().assign(tmp.begin(), tmp.end());
+        } else {
+          data.push_back(tmp);
+        }
       }
     }
     std::vector<std::vector<uint32_t>> queries;
@@ -426,13 +1945,38 @@ int main(int argc, char *argv[]) {
     }
               
     try { 
+      if (stream_mode) {
+        demo_stream(postings_file, queries, threshold);
+        return EXIT_SUCCESS;
+      }
+      if (replay_mode) {
+        demo_replay(data, queries, threshold);
+        return EXIT_SUCCESS;
+      }
+      if (shard_count > 0) {
+        demo_shards(data, queries, threshold, shard_count);
+        return EXIT_SUCCESS;
+      }
+      if (segmented_mode) {
+        demo_segmented(data, queries, threshold);
+        return EXIT_SUCCESS;
+      }
       demo_data(data, queries, threshold);
+      if (cache_mb > 0) {
+        demo_cache(data, queries, threshold, cache_mb * 1024 * 1024);
+      }
     } catch (const std::exception& e) {
       std::cerr << "Exception: " << e.what() << std::endl;
       return EXIT_FAILURE;
     }
   } else {
     try {
+      if (large) {
+        // 100 lists of 2M elements: about 800 MB of postings, far beyond the LLC
+        std::cout << "Large demo threshold:" << 3 << std::endl;
+        demo_random(200000000, 2000000, 100, 3);
+        return EXIT_SUCCESS;
+      }
       // Previous demo with threshold 3
       //demo_random(20000000, 50000, 100, 3);
       for (unsigned k = 1; k < 10; ++k) {
@@ -8,16 +8,29 @@
 
 #ifdef __linux__
 typedef LinuxEvents<PERF_TYPE_HARDWARE> EventClass;
+typedef LinuxEvents<PERF_TYPE_HW_CACHE> CacheEventClass;
+
+// Encodes a PERF_TYPE_HW_CACHE read-miss event, e.g., dTLB misses.
+// The resulting codes never collide with PERF_TYPE_HARDWARE codes.
+inline int cache_read_miss_event(int cache_id) {
+  return cache_id | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
 #endif
 
 class LinuxEventsWrapper {
   public:
-    LinuxEventsWrapper(const std::vector<int> event_codes) {
+    LinuxEventsWrapper(const std::vector<int> event_codes,
+                       const std::vector<int> cache_event_codes = {}) {
 #ifdef __linux__
       for(int ecode: event_codes) {
         event_obj.emplace(ecode, std::shared_ptr<EventClass>(new EventClass(ecode)));
         event_res.emplace(ecode, 0);
       }
+      for(int ecode: cache_event_codes) {
+        cache_event_obj.emplace(ecode, std::shared_ptr<CacheEventClass>(new CacheEventClass(ecode)));
+        event_res.emplace(ecode, 0);
+      }
 #endif
     }
     void start() {
@@ -25,6 +38,9 @@ class LinuxEventsWrapper {
       for (const auto& [ecode, ptr]: event_obj) {
         ptr->start();  
       }
+      for (const auto& [ecode, ptr]: cache_event_obj) {
+        ptr->start();  
+      }
 #endif
     }
     void end() {
@@ -32,6 +48,9 @@ class LinuxEventsWrapper {
       for (const auto& [ecode, ptr]: event_obj) {
         event_res[ecode] = ptr->end();  
       }
+      for (const auto& [ecode, ptr]: cache_event_obj) {
+        event_res[ecode] = ptr->end();  
+      }
 #endif
     }
     // Throws an exception if the code is not present
@@ -45,6 +64,7 @@ class LinuxEventsWrapper {
   private:
 #ifdef __linux__
     std::unordered_map<int, std::shared_ptr<EventClass>> event_obj;
+    std::unordered_map<int, std::shared_ptr<CacheEventClass>> cache_event_obj;
     std::unordered_map<int, unsigned long> event_res;
 #endif
 };
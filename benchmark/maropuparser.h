@@ -11,7 +11,9 @@
 #include <stdexcept>
 #include <sstream>
 
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 
 /**
@@ -0,0 +1,159 @@
+// Offline tool: renumbers the documents of a postings file so that documents
+// sharing lists get close ids (see fastscancount_reorder.h), and writes the
+// remapped postings. The queries name lists, not documents, so they are
+// written out unchanged next to the new postings. Compare the two with
+//   ./counter --postings <postings> --queries <queries> --threshold 3
+//   ./counter --postings <out postings> --queries <out queries> --threshold 3
+#include "fastscancount_reorder.h"
+#include "maropuparser.h"
+#include "ztimer.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+bool write_lists(const std::string &filename,
+                 const std::vector<std::vector<uint32_t>> &lists) {
+  FILE *fd = ::fopen(filename.c_str(), "wb");
+  if (fd == NULL) {
+    return false;
+  }
+  bool ok = true;
+  for (const auto &v : lists) {
+    uint32_t qty = uint32_t(v.size());
+    ok = ok && fwrite(&qty, sizeof(uint32_t), 1, fd) == 1;
+    ok = ok && fwrite(v.data(), sizeof(uint32_t), v.size(), fd) == v.size();
+  }
+  return ::fclose(fd) == 0 && ok;
+}
+
+bool read_lists(const std::string &filename,
+                std::vector<std::vector<uint32_t>> &lists) {
+  MaropuGapReader rdr(filename);
+  if (!rdr.open()) {
+    return false;
+  }
+  std::vector<uint32_t> tmp;
+  while (rdr.loadIntegers(tmp)) {
+    lists.push_back(tmp);
+  }
+  return true;
+}
+
+// what the window kernels care about: how many (list, window) slices there are,
+// and how far apart consecutive postings are
+void print_locality(const std::string &name,
+                    const std::vector<std::vector<uint32_t>> &lists) {
+  size_t slices = 0, gaps = 0;
+  double log_gaps = 0;
+  for (const auto &v : lists) {
+    for (size_t i = 0; i < v.size(); i++) {
+      if (i == 0 || (v[i] >> 16) != (v[i - 1] >> 16)) {
+        slices++;
+      }
+      if (i > 0) {
+        log_gaps += std::log2(double(v[i] - v[i - 1]));
+        gaps++;
+      }
+    }
+  }
+  std::cout << name << ": " << slices << " non-empty (list, window) slices, "
+            << log_gaps / std::max<size_t>(gaps, 1) << " bits per gap on average" << std::endl;
+}
+
+// parses a decimal integer > 0, returns false on anything else
+bool parse_positive(const std::string &value, size_t &out) {
+  if (value.empty() || value[0] < '0' || value[0] > '9') {
+    return false;
+  }
+  size_t pos = 0;
+  unsigned long v = 0;
+  try {
+    v = std::stoul(value, &pos);
+  } catch (const std::logic_error &) {
+    return false;
+  }
+  if (pos != value.size() || v == 0) {
+    return false;
+  }
+  out = v;
+  return true;
+}
+
+void usage(const std::string &err = "") {
+  if (!err.empty()) {
+    std::cerr << err << std::endl;
+  }
+  std::cerr << "Usage: --postings <postings file> --queries <queries file> "
+               "--out-postings <postings file> --out-queries <queries file> "
+               "[--iterations <n>] [--min-partition <n>]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  std::string postings_file, queries_file, out_postings_file, out_queries_file;
+  size_t iterations = 20, min_partition = 16;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (i + 1 == argc) {
+      usage("Missing value for " + arg);
+      return EXIT_FAILURE;
+    }
+    if (arg == "--postings") {
+      postings_file = argv[++i];
+    } else if (arg == "--queries") {
+      queries_file = argv[++i];
+    } else if (arg == "--out-postings") {
+      out_postings_file = argv[++i];
+    } else if (arg == "--out-queries") {
+      out_queries_file = argv[++i];
+    } else if (arg == "--iterations" || arg == "--min-partition") {
+      if (!parse_positive(argv[++i], arg == "--iterations" ? iterations : min_partition)) {
+        usage(arg + " expects a positive integer");
+        return EXIT_FAILURE;
+      }
+    } else {
+      usage("Unknown option: " + arg);
+      return EXIT_FAILURE;
+    }
+  }
+  if (postings_file.empty() || queries_file.empty() || out_postings_file.empty() ||
+      out_queries_file.empty()) {
+    usage("Specify the input and output postings and queries!");
+    return EXIT_FAILURE;
+  }
+  try {
+    std::vector<std::vector<uint32_t>> data, queries;
+    if (!read_lists(postings_file, data)) {
+      usage("Cannot open: " + postings_file);
+      return EXIT_FAILURE;
+    }
+    if (!read_lists(queries_file, queries)) {
+      usage("Cannot open: " + queries_file);
+      return EXIT_FAILURE;
+    }
+    print_locality("before", data);
+    WallClockTimer tm;
+    std::vector<uint32_t> new_id = fastscancount::bisection_order(data, iterations, min_partition);
+    fastscancount::remap_lists(data, new_id);
+    std::cout << "reordered " << new_id.size() << " documents in " << tm.split() / 1e6
+              << " s" << std::endl;
+    print_locality("after", data);
+    if (!write_lists(out_postings_file, data)) {
+      usage("Cannot write: " + out_postings_file);
+      return EXIT_FAILURE;
+    }
+    if (!write_lists(out_queries_file, queries)) {
+      usage("Cannot write: " + out_queries_file);
+      return EXIT_FAILURE;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -49,6 +49,73 @@ uint32_t *natefastscancount_finalcheck(uint8_t *counters, size_t &it,
   it = i;
   return out;
 }
+// used by fastscancount_sorted: same as natefastscancount_maincheck, but the
+// hits are recorded in a bitmap (one bit per value of the window)
+void sortedscancount_maincheck(uint8_t *counters, uint64_t *hits, size_t &it,
+                               const uint32_t *d, size_t start, size_t range,
+                               uint8_t threshold) {
+  range += start;
+  counters -= start;
+  size_t i = it;
+  for (uint32_t val = d[i]; val < range; val = d[++i]) {
+    uint8_t c = counters[val];
+    if (c == threshold) {
+      uint32_t off = val - start;
+      hits[off / 64] |= uint64_t(1) << (off % 64);
+    }
+    counters[val] = c + 1;
+  }
+  it = i;
+}
+
+// used by fastscancount_sorted
+void sortedscancount_finalcheck(uint8_t *counters, uint64_t *hits, size_t &it,
+                                const uint32_t *d, size_t start, size_t itend,
+                                uint8_t threshold) {
+  uint8_t *const deccounters = counters - start;
+  size_t i = it;
+  for (; i < itend; i++) {
+    uint32_t val = d[i];
+    uint8_t *location = deccounters + val;
+    uint8_t c = *location;
+    if (c == threshold) {
+      uint32_t off = val - start;
+      hits[off / 64] |= uint64_t(1) << (off % 64);
+    }
+    *location = c + 1;
+  }
+  it = i;
+}
+
+inline int trailing_zeroes(uint64_t bits) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(bits);
+#else
+  int r = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    r++;
+  }
+  return r;
+#endif
+}
+
+// writes the values whose bit is set in ascending order, and clears the bitmap
+uint32_t *sortedscancount_extract(uint64_t *hits, size_t words, size_t start,
+                                  uint32_t *out) {
+  for (size_t w = 0; w < words; w++) {
+    uint64_t bits = hits[w];
+    if (bits == 0)
+      continue;
+    hits[w] = 0;
+    uint32_t base = uint32_t(start + w * 64);
+    while (bits) {
+      *out++ = base + trailing_zeroes(bits);
+      bits &= bits - 1;
+    }
+  }
+  return out;
+}
 } // namespace
 
 void fastscancount(const std::vector<const std::vector<uint32_t>*> &data,
@@ -98,6 +165,59 @@ void fastscancount(const std::vector<const std::vector<uint32_t>*> &data,
   countsofar = output - initout;
   out.resize(countsofar);
 }
+
+// Same as fastscancount, except that the values are written to 'out' in
+// sorted order. Within each window, the hits are first marked in a bitmap and
+// then extracted in ascending order, so there is no need to sort afterwards.
+void fastscancount_sorted(const std::vector<const std::vector<uint32_t>*> &data,
+                          std::vector<uint32_t> &out, uint8_t threshold) {
+  size_t cache_size = 65536;
+  size_t range = cache_size;
+  std::vector<uint8_t> counters(cache_size);
+  std::vector<uint64_t> hits(range / 64);
+  size_t ds = data.size();
+  out.resize( 4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  uint32_t *initout = out.data();
+  std::vector<size_t> iters(ds);
+  size_t countsofar = 0;
+  uint32_t largest = 0;
+  for (size_t c = 0; c < ds; c++) {
+    if (largest < (*data[c])[data[c]->size() - 1])
+      largest = (*data[c])[data[c]->size() - 1];
+  }
+  // we are assuming that all vectors in data are non-empty
+  for (size_t start = 0; start <= largest; start += range) {
+    // make sure that the capacity is sufficient
+    countsofar = output - initout;
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      initout = out.data();
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    for (size_t c = 0; c < ds; c++) {
+      size_t it = iters[c]; // recover where we were
+      const std::vector<uint32_t> &d = *data[c];
+      const size_t itend = d.size();
+      if (it == itend) // check that there is data to be processed
+        continue;      // exhausted
+      // check if we need to be careful:
+      bool near_the_end = (d[itend - 1] < start + range);
+      if (near_the_end) {
+        sortedscancount_finalcheck(counters.data(), hits.data(), it, d.data(),
+                                   start, itend, threshold);
+      } else {
+        sortedscancount_maincheck(counters.data(), hits.data(), it, d.data(),
+                                  start, range, threshold);
+      }
+      iters[c] = it; // store it for next round
+    }
+    output = sortedscancount_extract(hits.data(), hits.size(), start, output);
+  }
+  countsofar = output - initout;
+  out.resize(countsofar);
+}
 } // namespace fastscancount
 
 #endif
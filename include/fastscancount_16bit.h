@@ -0,0 +1,149 @@
+#ifndef FASTSCANCOUNT_16BIT_H
+#define FASTSCANCOUNT_16BIT_H
+
+#ifdef __AVX2__
+#include "fastscancount_avx2.h"
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// Within a window of 65536 values, every value fits in 16 bits. A packed list
+// is a sequence of 16-bit words: for each non-empty window, a two-word header
+// (window number, number of values minus one) followed by the low 16 bits of
+// each value. The kernels below count directly from these offsets, which
+// halves the memory traffic of the counting loop.
+
+namespace fastscancount {
+
+// in must be strictly increasing, so that a window holds at most 65536 values
+void pack16(const std::vector<uint32_t> &in, std::vector<uint16_t> &out) {
+  out.clear();
+  out.reserve(in.size() + 2 * (size_t(in.empty() ? 0 : in.back()) / 65536 + 1));
+  for (size_t i = 0; i < in.size();) {
+    const uint32_t w = in[i] >> 16;
+    size_t j = i + 1;
+    while (j < in.size() && (in[j] >> 16) == w)
+      j++;
+    if (j - i > 65536)
+      throw std::invalid_argument("pack16: more than 65536 values in a window, the input has duplicates");
+    out.push_back(uint16_t(w));
+    out.push_back(uint16_t(j - i - 1));
+    for (; i < j; i++)
+      out.push_back(uint16_t(in[i]));
+  }
+}
+
+void unpack16(const std::vector<uint16_t> &in, std::vector<uint32_t> &out) {
+  out.clear();
+  for (size_t i = 0; i < in.size();) {
+    const uint32_t base = uint32_t(in[i]) << 16;
+    const size_t count = size_t(in[i + 1]) + 1;
+    i += 2;
+    for (size_t j = 0; j < count; j++)
+      out.push_back(base | in[i + j]);
+    i += count;
+  }
+}
+
+namespace {
+
+struct packed16_cursor {
+  const uint16_t *cur; // next window header
+  const uint16_t *end;
+};
+
+// returns the smallest window number among the cursors, or -1 if all of them
+// are exhausted
+int64_t packed16_next_window(const std::vector<packed16_cursor> &cursors) {
+  int64_t w = -1;
+  for (const auto &c : cursors) {
+    if (c.cur != c.end && (w < 0 || c.cur[0] < w))
+      w = c.cur[0];
+  }
+  return w;
+}
+
+std::vector<packed16_cursor>
+packed16_cursors(const std::vector<const std::vector<uint16_t> *> &data) {
+  std::vector<packed16_cursor> cursors;
+  cursors.reserve(data.size());
+  for (auto d : data) {
+    if (!d->empty())
+      cursors.push_back({d->data(), d->data() + d->size()});
+  }
+  return cursors;
+}
+
+} // namespace
+
+// Same result as fastscancount, from lists packed with pack16.
+void fastscancount_16bit(const std::vector<const std::vector<uint16_t> *> &data,
+                         std::vector<uint32_t> &out, uint8_t threshold) {
+  const size_t range = 65536;
+  std::vector<uint8_t> counters(range);
+  std::vector<packed16_cursor> cursors = packed16_cursors(data);
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  for (int64_t w; (w = packed16_next_window(cursors)) >= 0;) {
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    const uint32_t base = uint32_t(w) << 16;
+    uint8_t *const cdata = counters.data();
+    for (auto &c : cursors) {
+      if (c.cur == c.end || c.cur[0] != w)
+        continue;
+      const uint16_t *it = c.cur + 2;
+      const uint16_t *itend = it + size_t(c.cur[1]) + 1;
+      for (; it != itend; it++) {
+        uint16_t off = *it;
+        uint8_t count = cdata[off];
+        if (count == threshold)
+          *output++ = base | off;
+        cdata[off] = count + 1;
+      }
+      c.cur = itend;
+    }
+  }
+  out.resize(output - out.data());
+}
+
+#ifdef __AVX2__
+// Same as fastscancount_avx2, from lists packed with pack16. The output is
+// sorted.
+void fastscancount_16bit_avx2(
+    const std::vector<const std::vector<uint16_t> *> &data,
+    std::vector<uint32_t> &out, uint8_t threshold) {
+  const size_t range = 65536;
+  std::vector<uint8_t> counters(range);
+  std::vector<packed16_cursor> cursors = packed16_cursors(data);
+  out.clear();
+  for (int64_t w; (w = packed16_next_window(cursors)) >= 0;) {
+    memset(counters.data(), 0, range);
+    uint8_t *const cdata = counters.data();
+    for (auto &c : cursors) {
+      if (c.cur == c.end || c.cur[0] != w)
+        continue;
+      const uint16_t *it = c.cur + 2;
+      const uint16_t *itend = it + size_t(c.cur[1]) + 1;
+      for (; it != itend; it++) {
+        cdata[*it]++;
+      }
+      c.cur = itend;
+    }
+    populate_hits_avx(counters, range, threshold, size_t(w) << 16, out);
+  }
+}
+#endif
+
+} // namespace fastscancount
+#endif
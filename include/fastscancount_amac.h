@@ -0,0 +1,108 @@
+#ifndef FASTSCANCOUNT_AMAC_H
+#define FASTSCANCOUNT_AMAC_H
+
+#include "fastscancount_hugepages.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// scancount over one counter per value of the whole universe, like the
+// baseline, but with the cache misses on the counters overlapped in the
+// style of AMAC (asynchronous memory access chaining). The lists are cut into
+// segments, and 'group' lanes each walk a segment as a small state machine:
+// a lane prefetches the counter of its next value and yields to the next
+// lane; by the time the round-robin comes back to it, the counter is in cache
+// and it can be incremented. There are no windows, so no per-window overhead,
+// but the memory latency is hidden behind the other lanes.
+
+namespace fastscancount {
+
+namespace {
+
+struct amac_lane {
+  const uint32_t *cur; // next value of the segment
+  const uint32_t *end;
+  uint32_t pending;    // value whose counter was prefetched
+  bool busy;
+};
+
+struct amac_segment {
+  const uint32_t *begin;
+  const uint32_t *end;
+};
+
+} // namespace
+
+// Same result as fastscancount. group is the number of lanes in flight.
+void fastscancount_amac(const std::vector<const std::vector<uint32_t>*> &data,
+                        std::vector<uint32_t> &out, uint8_t threshold,
+                        size_t group = 32) {
+  out.clear();
+  uint64_t largest = 0;
+  size_t total = 0;
+  for (auto d : data) {
+    if (d->empty())
+      continue;
+    largest = std::max<uint64_t>(largest, d->back());
+    total += d->size();
+  }
+  if (total == 0)
+    return;
+  if (group == 0)
+    group = 1;
+  // the counters are accessed at random: huge pages spare most TLB misses
+  huge_vector<uint8_t> counters(largest + 1);
+  uint8_t *const cdata = counters.data();
+  // several segments per lane, so that the lanes finish at about the same time
+  const size_t segment_size = std::max<size_t>(1024, total / (4 * group));
+  std::vector<amac_segment> segments;
+  for (auto d : data) {
+    for (size_t i = 0; i < d->size(); i += segment_size) {
+      segments.push_back({d->data() + i, d->data() + std::min(d->size(), i + segment_size)});
+    }
+  }
+  size_t next_segment = 0;
+  std::vector<amac_lane> lanes(std::min(group, segments.size()));
+  auto start_lane = [&](amac_lane &l) {
+    // segments are never empty
+    if (next_segment == segments.size()) {
+      l.busy = false;
+      return;
+    }
+    l.cur = segments[next_segment].begin;
+    l.end = segments[next_segment].end;
+    next_segment++;
+    l.pending = *l.cur++;
+    __builtin_prefetch(cdata + l.pending, 1);
+    l.busy = true;
+  };
+  for (amac_lane &l : lanes)
+    start_lane(l);
+  out.resize(total / (size_t(threshold) + 1) + 1); // enough for all hits
+  uint32_t *output = out.data();
+  for (size_t busy = lanes.size(); busy > 0;) {
+    for (amac_lane &l : lanes) {
+      if (!l.busy)
+        continue;
+      // the counter of l.pending was prefetched during the previous round
+      const uint32_t val = l.pending;
+      const uint8_t c = cdata[val];
+      if (c == threshold)
+        *output++ = val;
+      cdata[val] = c + 1;
+      if (l.cur != l.end) {
+        l.pending = *l.cur++;
+        __builtin_prefetch(cdata + l.pending, 1);
+      } else {
+        start_lane(l);
+        busy -= !l.busy;
+      }
+    }
+  }
+  out.resize(output - out.data());
+}
+
+} // namespace fastscancount
+#endif
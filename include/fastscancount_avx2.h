@@ -9,6 +9,8 @@
 #include <x86intrin.h>
 #endif
 
+#include "fastscancount_deleted.h"
+
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
@@ -43,10 +45,54 @@ static inline size_t find_next_gt(uint8_t *array, const size_t size,
   return SIZE_MAX;
 }
 
+// same as find_next_gt, skipping the deleted documents; array[0] counts
+// document start
+static inline size_t find_next_gt_live(uint8_t *array, const size_t size,
+                                       const uint8_t threshold,
+                                       const std::vector<uint64_t> &deleted,
+                                       size_t start) {
+  size_t vsize = size / 32;
+  __m256i *varray = (__m256i *)array;
+  const __m256i comprand = _mm256_set1_epi8(threshold);
+  uint32_t bits = 0;
+
+  for (size_t i = 0; i < vsize; i++) {
+    __m256i v = _mm256_loadu_si256(varray + i);
+    __m256i cmp = _mm256_cmpgt_epi8(v, comprand);
+    bits = uint32_t(_mm256_movemask_epi8(cmp));
+    if (bits && (bits &= ~uint32_t(deleted_bits(deleted, start + i * 32)))) {
+      return i * 32 + __builtin_ctz(bits);
+    }
+  }
+
+  // tail handling
+  for (size_t i = vsize * 32; i < size; i++) {
+    auto v = array[i];
+    if (v > threshold && !is_deleted(deleted, start + i))
+      return i;
+  }
+
+  return SIZE_MAX;
+}
+
+// when deleted is given, deleted documents are left out
 void populate_hits_avx(std::vector<uint8_t> &counters, size_t range,
                        size_t threshold, size_t start,
-                       std::vector<uint32_t> &out) {
+                       std::vector<uint32_t> &out,
+                       const std::vector<uint64_t> *deleted = nullptr) {
   uint8_t *array = counters.data();
+  if (deleted != nullptr) {
+    while (true) {
+      size_t next = find_next_gt_live(array, range, (uint8_t)threshold, *deleted, start);
+      if (next == SIZE_MAX)
+        break;
+      out.push_back(start + next);
+      range -= (next + 1);
+      array += (next + 1);
+      start += (next + 1);
+    }
+    return;
+  }
 
   size_t ro = range;
   while (true) {
@@ -80,8 +126,11 @@ void update_counters_final(const uint32_t *&it_, const uint32_t *end,
 }
 } // namespace
 
+// deleted, if given, is a bitmap of documents to leave out of the output (see
+// fastscancount_deleted.h)
 void fastscancount_avx2(const std::vector<const std::vector<uint32_t>*> &data,
-                        std::vector<uint32_t> &out, uint8_t threshold) {
+                        std::vector<uint32_t> &out, uint8_t threshold,
+                        const std::vector<uint64_t> *deleted = nullptr) {
   const size_t cache_size = 40000;
   std::vector<uint8_t> counters(cache_size);
   out.clear();
@@ -123,7 +172,7 @@ void fastscancount_avx2(const std::vector<const std::vector<uint32_t>*> &data,
       }
     }
 
-    populate_hits_avx(counters, cache_size, threshold, start, out);
+    populate_hits_avx(counters, cache_size, threshold, start, out, deleted);
   }
 }
 
@@ -9,6 +9,8 @@
 #include <x86intrin.h>
 #endif
 
+#include "fastscancount_deleted.h"
+
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
@@ -20,9 +22,11 @@ namespace fastscancount {
 namespace {
 
 // credit: inspired by 256-bit implementation of Travis Downes
+// when deleted is given, deleted documents are left out
 void populate_hits_avx512(std::vector<uint8_t> &counters, size_t range,
                        size_t threshold, size_t start,
-                       std::vector<uint32_t> &out) {
+                       std::vector<uint32_t> &out,
+                       const std::vector<uint64_t> *deleted = nullptr) {
   uint8_t *array = counters.data();
 
   size_t vsize = range / 64;
@@ -33,6 +37,8 @@ void populate_hits_avx512(std::vector<uint8_t> &counters, size_t range,
     size_t start_add = start + i*64;
     __m512i v = _mm512_loadu_si512(varray + i);
     uint64_t bits = _mm512_cmpgt_epi8_mask(v, comprand);
+    if (bits && deleted != nullptr)
+      bits &= ~deleted_bits(*deleted, start_add);
     while (bits) {
       unsigned zqty = __builtin_ctzll(bits);
       bits >>= zqty; 
@@ -44,7 +50,7 @@ void populate_hits_avx512(std::vector<uint8_t> &counters, size_t range,
 
   for (size_t i = vsize * 64; i < range; i++) {
     auto v = array[i];
-    if (v > threshold)
+    if (v > threshold && (deleted == nullptr || !is_deleted(*deleted, start + i)))
       out.push_back(start + i);
   }
 
@@ -93,7 +99,8 @@ void update_counters_avx512(const uint32_t  *&it_, const uint32_t  *end,
 void fastscancount_avx512(uint32_t cache_size,
                           const std::vector<const std::vector<uint32_t>*> &data,
                           const std::vector<const std::vector<uint32_t>*> &range_ends,
-                          std::vector<uint32_t> &out, uint8_t threshold) {
+                          std::vector<uint32_t> &out, uint8_t threshold,
+                          const std::vector<uint64_t> *deleted = nullptr) {
   std::vector<uint8_t> counters(cache_size);
   out.clear();
   const size_t dsize = data.size();
@@ -130,7 +137,7 @@ void fastscancount_avx512(uint32_t cache_size,
       update_counters_avx512(it[k], &v[0] + r[i], cdata, start);
     }
 
-    populate_hits_avx512(counters, cache_size, threshold, start, out);
+    populate_hits_avx512(counters, cache_size, threshold, start, out, deleted);
   }
 }
 
@@ -0,0 +1,185 @@
+#ifndef FASTSCANCOUNT_BITMAP_H
+#define FASTSCANCOUNT_BITMAP_H
+
+// this code expects an x64 processor with AVX2 (AVX-512BW is used when
+// available)
+
+#include "fastscancount_avx2.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// When the threshold is low, the result may contain millions of values and
+// writing them one at a time into a std::vector dominates. Here the result is
+// a Roaring-style set: one container per window of 65536 values, stored as a
+// bitmap when it is dense and as a sorted array of 16-bit offsets otherwise.
+// Bitmaps are built directly from the SIMD comparison masks.
+
+namespace fastscancount {
+
+struct hit_container {
+  uint32_t base = 0;             // first value covered by this container
+  uint32_t cardinality = 0;      // number of values
+  std::vector<uint16_t> values;  // sorted offsets, for sparse containers
+  std::vector<uint64_t> words;   // 1024 words, for dense containers
+
+  // same cutoff as Roaring: an array of more than 4096 16-bit values
+  // takes more room than a bitmap
+  static const uint32_t array_max = 4096;
+
+  bool is_bitmap() const { return !words.empty(); }
+
+  bool contains(uint32_t val) const {
+    if (val < base || val - base >= 65536)
+      return false;
+    uint32_t off = val - base;
+    if (is_bitmap())
+      return (words[off / 64] >> (off % 64)) & 1;
+    return std::binary_search(values.begin(), values.end(), uint16_t(off));
+  }
+};
+
+struct hit_set {
+  std::vector<hit_container> containers; // sorted by base, none are empty
+
+  void clear() { containers.clear(); }
+
+  size_t cardinality() const {
+    size_t card = 0;
+    for (const auto &c : containers)
+      card += c.cardinality;
+    return card;
+  }
+
+  bool contains(uint32_t val) const {
+    auto it = std::upper_bound(
+        containers.begin(), containers.end(), val,
+        [](uint32_t v, const hit_container &c) { return v < c.base; });
+    if (it == containers.begin())
+      return false;
+    return (it - 1)->contains(val);
+  }
+
+  // appends all values, in sorted order
+  void to_vector(std::vector<uint32_t> &out) const {
+    out.clear();
+    out.reserve(cardinality());
+    for (const auto &c : containers) {
+      if (c.is_bitmap()) {
+        for (size_t w = 0; w < c.words.size(); w++) {
+          uint64_t bits = c.words[w];
+          while (bits) {
+            out.push_back(c.base + w * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+          }
+        }
+      } else {
+        for (uint16_t off : c.values)
+          out.push_back(c.base + off);
+      }
+    }
+  }
+};
+
+namespace {
+
+// writes one bit per counter (set if the counter exceeds the threshold) into
+// words and returns the number of bits set
+size_t populate_hits_bitmap(const uint8_t *array, size_t range,
+                            uint8_t threshold, uint64_t *words) {
+  size_t card = 0;
+  size_t vsize = range / 64;
+#ifdef __AVX512BW__
+  const __m512i comprand = _mm512_set1_epi8(threshold);
+  for (size_t i = 0; i < vsize; i++) {
+    __m512i v = _mm512_loadu_si512((const __m512i *)(array + i * 64));
+    uint64_t bits = _mm512_cmpgt_epi8_mask(v, comprand);
+    words[i] = bits;
+    card += __builtin_popcountll(bits);
+  }
+#else
+  const __m256i comprand = _mm256_set1_epi8(threshold);
+  for (size_t i = 0; i < vsize; i++) {
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(array + i * 64));
+    __m256i v2 = _mm256_loadu_si256((const __m256i *)(array + i * 64 + 32));
+    uint32_t lo = _mm256_movemask_epi8(_mm256_cmpgt_epi8(v1, comprand));
+    uint32_t hi = _mm256_movemask_epi8(_mm256_cmpgt_epi8(v2, comprand));
+    uint64_t bits = uint64_t(lo) | (uint64_t(hi) << 32);
+    words[i] = bits;
+    card += __builtin_popcountll(bits);
+  }
+#endif
+  return card;
+}
+
+void bitmap_to_array(const uint64_t *words, size_t nwords,
+                     std::vector<uint16_t> &values) {
+  for (size_t w = 0; w < nwords; w++) {
+    uint64_t bits = words[w];
+    while (bits) {
+      values.push_back(uint16_t(w * 64 + __builtin_ctzll(bits)));
+      bits &= bits - 1;
+    }
+  }
+}
+
+} // namespace
+
+// Same as fastscancount_avx2, except that the result goes to a hit_set.
+// The AVX2 limit of fewer than 128 arrays applies.
+void fastscancount_bitmap(const std::vector<const std::vector<uint32_t>*> &data,
+                          hit_set &out, uint8_t threshold) {
+  const size_t cache_size = 65536;
+  std::vector<uint8_t> counters(cache_size);
+  std::vector<uint64_t> scratch(cache_size / 64);
+  out.clear();
+
+  struct data_info {
+    const uint32_t *cur; // current pointer into data
+    const uint32_t *end; // pointer to end
+    uint32_t last;       // value of last element
+  };
+
+  std::vector<data_info> iter_data;
+  iter_data.reserve(data.size());
+  uint32_t largest = 0;
+  for (auto &d : data) {
+    if (d->empty())
+      continue;
+    iter_data.push_back({d->data(), d->data() + d->size(), d->back()});
+    largest = std::max(largest, d->back());
+  }
+  if (iter_data.empty())
+    return;
+  auto cdata = counters.data();
+  for (uint64_t start = 0; start <= largest; start += cache_size) {
+    memset(cdata, 0, cache_size * sizeof(counters[0]));
+    for (auto &id : iter_data) {
+      if (id.last >= start + cache_size) {
+        update_counters(id.cur, cdata - start, uint32_t(start + cache_size));
+      } else {
+        update_counters_final(id.cur, id.end, cdata - start);
+      }
+    }
+    size_t card = populate_hits_bitmap(cdata, cache_size, threshold,
+                                       scratch.data());
+    if (card == 0)
+      continue;
+    out.containers.emplace_back();
+    hit_container &c = out.containers.back();
+    c.base = uint32_t(start);
+    c.cardinality = uint32_t(card);
+    if (card > hit_container::array_max) {
+      c.words = scratch;
+    } else {
+      c.values.reserve(card);
+      bitmap_to_array(scratch.data(), scratch.size(), c.values);
+    }
+  }
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,154 @@
+#ifndef FASTSCANCOUNT_BOOLEAN_H
+#define FASTSCANCOUNT_BOOLEAN_H
+
+#include "fastscancount.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Boolean T-occurrence queries: "contains all of the required lists, none of
+// the excluded lists, and more than 'threshold' of the optional lists".
+// Within each window, the required and excluded lists are turned into a
+// bitmap mask which is applied to the hit bitmap of the optional lists,
+// so only qualifying values are extracted.
+
+namespace fastscancount {
+namespace {
+
+// returns the index of the first value of d that is >= range_end, starting
+// from it
+size_t boolean_slice_end(const std::vector<uint32_t> &d, size_t it,
+                         uint64_t range_end) {
+  if (range_end > UINT32_MAX)
+    return d.size();
+  return std::lower_bound(d.begin() + it, d.end(), uint32_t(range_end)) -
+         d.begin();
+}
+
+void boolean_set_bits(uint64_t *bitmap, const uint32_t *begin,
+                      const uint32_t *end, size_t start) {
+  for (const uint32_t *p = begin; p != end; p++) {
+    uint32_t off = uint32_t(*p - start);
+    bitmap[off / 64] |= uint64_t(1) << (off % 64);
+  }
+}
+
+void boolean_clear_bits(uint64_t *bitmap, const uint32_t *begin,
+                        const uint32_t *end, size_t start) {
+  for (const uint32_t *p = begin; p != end; p++) {
+    uint32_t off = uint32_t(*p - start);
+    bitmap[off / 64] &= ~(uint64_t(1) << (off % 64));
+  }
+}
+
+} // namespace
+
+// The result is written to 'out' in sorted order. If 'required' is empty,
+// every value is a candidate. An empty required list yields an empty result.
+void fastscancount_boolean(
+    const std::vector<const std::vector<uint32_t> *> &required,
+    const std::vector<const std::vector<uint32_t> *> &excluded,
+    const std::vector<const std::vector<uint32_t> *> &optional,
+    std::vector<uint32_t> &out, uint8_t threshold) {
+  const size_t range = 65536;
+  const size_t words = range / 64;
+  out.clear();
+  uint32_t largest = 0;
+  for (auto d : optional) {
+    if (!d->empty())
+      largest = std::max(largest, d->back());
+  }
+  for (auto d : required) {
+    if (d->empty())
+      return;
+    // no value beyond the end of a required list can qualify
+    largest = std::min(largest, d->back());
+  }
+  std::vector<uint8_t> counters(range);
+  std::vector<uint64_t> hits(words);
+  std::vector<uint64_t> mask(words);
+  std::vector<uint64_t> tmp(words);
+  std::vector<size_t> req_iters(required.size());
+  std::vector<size_t> exc_iters(excluded.size());
+  std::vector<size_t> opt_iters(optional.size());
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  for (size_t start = 0; start <= largest; start += range) {
+    const uint64_t range_end = start + range;
+    // first, the mask of the values that are in all required lists
+    bool empty_mask = false;
+    if (required.empty()) {
+      std::fill(mask.begin(), mask.end(), ~uint64_t(0));
+    }
+    for (size_t c = 0; c < required.size(); c++) {
+      const std::vector<uint32_t> &d = *required[c];
+      size_t it = req_iters[c];
+      size_t itend = boolean_slice_end(d, it, range_end);
+      req_iters[c] = itend;
+      if (empty_mask)
+        continue; // only advance the iterator
+      if (it == itend) {
+        empty_mask = true;
+        continue;
+      }
+      if (c == 0) {
+        std::fill(mask.begin(), mask.end(), 0);
+        boolean_set_bits(mask.data(), d.data() + it, d.data() + itend, start);
+      } else {
+        std::fill(tmp.begin(), tmp.end(), 0);
+        boolean_set_bits(tmp.data(), d.data() + it, d.data() + itend, start);
+        for (size_t w = 0; w < words; w++)
+          mask[w] &= tmp[w];
+      }
+    }
+    for (size_t c = 0; c < excluded.size(); c++) {
+      const std::vector<uint32_t> &d = *excluded[c];
+      size_t it = exc_iters[c];
+      size_t itend = boolean_slice_end(d, it, range_end);
+      exc_iters[c] = itend;
+      if (!empty_mask)
+        boolean_clear_bits(mask.data(), d.data() + it, d.data() + itend, start);
+    }
+    if (empty_mask) {
+      // nothing can qualify in this window: skip the optional lists
+      for (size_t c = 0; c < optional.size(); c++) {
+        opt_iters[c] = boolean_slice_end(*optional[c], opt_iters[c], range_end);
+      }
+      continue;
+    }
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    for (size_t c = 0; c < optional.size(); c++) {
+      size_t it = opt_iters[c]; // recover where we were
+      const std::vector<uint32_t> &d = *optional[c];
+      const size_t itend = d.size();
+      if (it == itend) // check that there is data to be processed
+        continue;      // exhausted
+      // check if we need to be careful:
+      bool near_the_end = (d[itend - 1] < range_end);
+      if (near_the_end) {
+        sortedscancount_finalcheck(counters.data(), hits.data(), it, d.data(),
+                                   start, itend, threshold);
+      } else {
+        sortedscancount_maincheck(counters.data(), hits.data(), it, d.data(),
+                                  start, range, threshold);
+      }
+      opt_iters[c] = it; // store it for next round
+    }
+    for (size_t w = 0; w < words; w++)
+      hits[w] &= mask[w];
+    output = sortedscancount_extract(hits.data(), words, start, output);
+  }
+  out.resize(output - out.data());
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,124 @@
+#ifndef FASTSCANCOUNT_CACHE_H
+#define FASTSCANCOUNT_CACHE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// An in-process cache of query results, bounded by memory, with LRU eviction.
+// Queries are keyed by their sorted list of term ids (duplicates are kept
+// since a repeated term counts twice) and the threshold.
+
+namespace fastscancount {
+
+class result_cache {
+public:
+  explicit result_cache(size_t max_bytes) : max_bytes(max_bytes) {}
+
+  // Returns the cached result or nullptr. The pointer is valid until the
+  // next call to insert.
+  const std::vector<uint32_t> *find(const std::vector<uint32_t> &terms,
+                                    uint8_t threshold) {
+    auto it = index.find(make_key(terms, threshold));
+    if (it == index.end()) {
+      misses++;
+      return nullptr;
+    }
+    hits++;
+    // move to the front: most recently used
+    entries.splice(entries.begin(), entries, it->second);
+    return &it->second->result;
+  }
+
+  // Results that would not fit in the whole cache are not stored.
+  void insert(const std::vector<uint32_t> &terms, uint8_t threshold,
+              const std::vector<uint32_t> &result) {
+    key k = make_key(terms, threshold);
+    size_t cost = entry_bytes(k, result);
+    if (cost > max_bytes)
+      return;
+    auto it = index.find(k);
+    if (it != index.end()) {
+      erase(it->second);
+    }
+    while (used_bytes + cost > max_bytes) {
+      erase(std::prev(entries.end()));
+    }
+    entries.push_front({k, result, cost});
+    index.emplace(std::move(k), entries.begin());
+    used_bytes += cost;
+  }
+
+  void clear() {
+    entries.clear();
+    index.clear();
+    used_bytes = 0;
+  }
+
+  size_t size() const { return entries.size(); }
+  size_t bytes() const { return used_bytes; }
+  size_t hit_count() const { return hits; }
+  size_t miss_count() const { return misses; }
+  double hit_rate() const {
+    return (hits + misses) ? double(hits) / (hits + misses) : 0;
+  }
+
+private:
+  struct key {
+    std::vector<uint32_t> terms; // sorted
+    uint8_t threshold;
+    bool operator==(const key &o) const {
+      return threshold == o.threshold && terms == o.terms;
+    }
+  };
+
+  struct key_hash {
+    size_t operator()(const key &k) const {
+      uint64_t h = 0x9E3779B97F4A7C15ull ^ k.threshold;
+      for (uint32_t t : k.terms) {
+        h ^= t;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+      }
+      return size_t(h);
+    }
+  };
+
+  struct entry {
+    key k;
+    std::vector<uint32_t> result;
+    size_t cost; // bytes accounted for this entry
+  };
+
+  static key make_key(const std::vector<uint32_t> &terms, uint8_t threshold) {
+    key k{terms, threshold};
+    std::sort(k.terms.begin(), k.terms.end());
+    return k;
+  }
+
+  // approximate footprint: payloads plus list, map and vector bookkeeping
+  static size_t entry_bytes(const key &k, const std::vector<uint32_t> &result) {
+    return 2 * k.terms.size() * sizeof(uint32_t) +
+           result.size() * sizeof(uint32_t) + 2 * sizeof(entry) + 64;
+  }
+
+  void erase(std::list<entry>::iterator e) {
+    used_bytes -= e->cost;
+    index.erase(e->k);
+    entries.erase(e);
+  }
+
+  size_t max_bytes;
+  size_t used_bytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+  std::list<entry> entries; // most recently used first
+  std::unordered_map<key, std::list<entry>::iterator, key_hash> index;
+};
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,36 @@
+#ifndef FASTSCANCOUNT_DELETED_H
+#define FASTSCANCOUNT_DELETED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Deleted documents, as a bitmap: bit v % 64 of word v / 64 is set when
+// document v is deleted. Documents beyond the end of the bitmap are live.
+// fastscancount_avx2 and fastscancount_avx512 take such a bitmap and clear
+// the deleted documents from the comparison masks of each window, so they
+// never reach the output.
+
+namespace fastscancount {
+
+inline void mark_deleted(std::vector<uint64_t> &deleted, uint32_t doc) {
+  if (doc / 64 >= deleted.size())
+    deleted.resize(doc / 64 + 1);
+  deleted[doc / 64] |= uint64_t(1) << (doc % 64);
+}
+
+inline bool is_deleted(const std::vector<uint64_t> &deleted, size_t doc) {
+  return doc / 64 < deleted.size() && ((deleted[doc / 64] >> (doc % 64)) & 1);
+}
+
+// the bits of documents [pos, pos + 64), pos need not be a multiple of 64
+inline uint64_t deleted_bits(const std::vector<uint64_t> &deleted, size_t pos) {
+  const size_t word = pos / 64, offset = pos % 64;
+  uint64_t bits = word < deleted.size() ? deleted[word] >> offset : 0;
+  if (offset != 0 && word + 1 < deleted.size())
+    bits |= deleted[word + 1] << (64 - offset);
+  return bits;
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,130 @@
+#ifndef FASTSCANCOUNT_ESTIMATE_H
+#define FASTSCANCOUNT_ESTIMATE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Estimates how many values fastscancount would return, by counting only a
+// sample of the windows. The value range is cut into windows of window_size
+// values and into strata of about 1/sample_fraction consecutive windows; one
+// window is drawn at random from each stratum, so the sample is spread over
+// the whole range and the lists are read forward. Each list is located in a
+// sampled window by a galloping search, so the cost is roughly
+// sample_fraction of the counting work plus a short search per list and
+// window.
+
+namespace fastscancount {
+
+namespace {
+
+// first position in [it, end) holding a value >= target; the sampled windows
+// are close to each other, so gallop forward before searching
+const uint32_t *estimate_seek(const uint32_t *it, const uint32_t *end,
+                              uint64_t target) {
+  size_t step = 1;
+  const uint32_t *lo = it;
+  while (size_t(end - lo) > step && lo[step] < target) {
+    lo += step;
+    step *= 2;
+  }
+  return std::lower_bound(lo, lo + std::min(step + 1, size_t(end - lo)), target);
+}
+
+} // namespace
+
+struct hit_estimate {
+  double hits = 0; // estimated number of values occurring more than threshold times
+  double low = 0;  // bounds of an approximate 95% confidence interval
+  double high = 0;
+  size_t windows = 0; // windows in the value range
+  size_t sampled = 0; // windows that were counted
+  bool exact() const { return sampled == windows; }
+};
+
+hit_estimate fastscancount_estimate(const std::vector<const std::vector<uint32_t>*> &data,
+                                    uint8_t threshold, double sample_fraction = 1.0 / 32,
+                                    uint32_t window_size = 4096, uint64_t seed = 0) {
+  hit_estimate result;
+  uint64_t largest = 0;
+  bool any = false;
+  for (auto d : data) {
+    if (!d->empty()) {
+      largest = std::max<uint64_t>(largest, d->back());
+      any = true;
+    }
+  }
+  if (!any || data.size() <= threshold || window_size == 0)
+    return result;
+  const uint64_t windows = largest / window_size + 1;
+  const uint64_t stratum = sample_fraction >= 1 || sample_fraction <= 0
+                               ? 1
+                               : std::min<uint64_t>(windows, uint64_t(1 / sample_fraction));
+  std::vector<uint8_t> counters(window_size);
+  std::vector<const uint32_t *> cur(data.size()), end(data.size());
+  for (size_t c = 0; c < data.size(); c++) {
+    cur[c] = data[c]->data();
+    end[c] = data[c]->data() + data[c]->size();
+  }
+  std::mt19937_64 gen(seed);
+  // sum and sum of squares of the hits per sampled window
+  double sum = 0, sum_squares = 0;
+  size_t sampled = 0;
+  for (uint64_t first = 0; first < windows; first += stratum) {
+    const uint64_t size = std::min(stratum, windows - first);
+    const uint64_t w = first + (size > 1 ? gen() % size : 0);
+    const uint64_t start = w * window_size;
+    const uint64_t range_end = start + window_size;
+    memset(counters.data(), 0, window_size);
+    uint8_t *const deccounters = counters.data() - start;
+    size_t hits = 0;
+    for (size_t c = 0; c < data.size(); c++) {
+      const uint32_t *it = estimate_seek(cur[c], end[c], start);
+      for (; it != end[c] && *it < range_end; it++) {
+        uint32_t val = *it;
+        uint8_t count = deccounters[val];
+        hits += (count == threshold);
+        deccounters[val] = count + 1;
+      }
+      cur[c] = it;
+    }
+    sum += double(hits);
+    sum_squares += double(hits) * double(hits);
+    sampled++;
+  }
+  result.windows = size_t(windows);
+  result.sampled = sampled;
+  const double mean = sum / double(sampled);
+  result.hits = mean * double(windows);
+  if (sampled == windows || sampled < 2) {
+    result.low = result.high = result.hits;
+    if (sampled < windows) {
+      // a single sampled window says nothing about the spread
+      result.low = sum;
+      result.high = double(windows) * double(window_size);
+    }
+    return result;
+  }
+  // simple random sampling of windows, with the finite population
+  // correction; stratification only makes the actual error smaller
+  const double correction = 1 - double(sampled) / double(windows);
+  const double variance =
+      std::max(0.0, (sum_squares - sum * mean) / double(sampled - 1));
+  double stderror =
+      double(windows) * std::sqrt(correction * variance / double(sampled));
+  // with few hits in the sample, the spread between windows is not a
+  // reliable guide: treat the sampled hits as a Poisson count instead (at
+  // least 3 of them, the usual bound when none are seen)
+  const double scale = double(windows) / double(sampled);
+  stderror = std::max(stderror, scale * std::sqrt(correction * std::max(sum, 3.0)));
+  result.low = std::max(sum, result.hits - 1.96 * stderror);
+  result.high = result.hits + 1.96 * stderror;
+  return result;
+}
+
+} // namespace fastscancount
+#endif
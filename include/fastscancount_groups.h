@@ -0,0 +1,161 @@
+#ifndef FASTSCANCOUNT_GROUPS_H
+#define FASTSCANCOUNT_GROUPS_H
+
+// this code expects an x64 processor with AVX2
+
+#include "fastscancount_avx2.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Groups of lists that are often queried together (e.g., synonym expansions)
+// can have their per-window counts materialized at index time. At query time,
+// a group is then merged with one SIMD byte addition per window instead of
+// counting each of its lists element by element.
+
+namespace fastscancount {
+
+struct materialized_group {
+  static const uint32_t window_size = 65536;
+  // windows with more non-zero counters than this are stored densely
+  static const uint32_t sparse_max = 4096;
+
+  struct window {
+    uint32_t start;                // first value covered by the window
+    std::vector<uint8_t> dense;    // window_size counters, or empty
+    std::vector<uint16_t> offsets; // sparse: positions of non-zero counters
+    std::vector<uint8_t> counts;   // sparse: their values
+  };
+
+  std::vector<window> windows; // sorted by start, empty windows are omitted
+  size_t list_count = 0;
+
+  size_t bytes() const {
+    size_t b = 0;
+    for (const auto &w : windows)
+      b += w.dense.size() + w.offsets.size() * 3 + sizeof(window);
+    return b;
+  }
+};
+
+// Precomputes the counts of the given lists, one window at a time.
+void materialize_group(const std::vector<const std::vector<uint32_t>*> &lists,
+                       materialized_group &group) {
+  const size_t range = materialized_group::window_size;
+  group.windows.clear();
+  group.list_count = lists.size();
+  uint32_t largest = 0;
+  for (auto d : lists) {
+    if (!d->empty())
+      largest = std::max(largest, d->back());
+  }
+  std::vector<uint8_t> counters(range);
+  std::vector<size_t> iters(lists.size());
+  for (uint64_t start = 0; start <= largest; start += range) {
+    memset(counters.data(), 0, range);
+    size_t nonzero = 0;
+    for (size_t c = 0; c < lists.size(); c++) {
+      const std::vector<uint32_t> &d = *lists[c];
+      size_t i = iters[c];
+      for (; i < d.size() && d[i] < start + range; i++) {
+        nonzero += (counters[d[i] - start]++ == 0);
+      }
+      iters[c] = i;
+    }
+    if (nonzero == 0)
+      continue;
+    group.windows.emplace_back();
+    materialized_group::window &w = group.windows.back();
+    w.start = uint32_t(start);
+    if (nonzero > materialized_group::sparse_max) {
+      w.dense = counters;
+    } else {
+      w.offsets.reserve(nonzero);
+      w.counts.reserve(nonzero);
+      for (size_t j = 0; j < range; j++) {
+        if (counters[j]) {
+          w.offsets.push_back(uint16_t(j));
+          w.counts.push_back(counters[j]);
+        }
+      }
+    }
+  }
+}
+
+namespace {
+
+void add_group_window(const materialized_group::window &w, uint8_t *counters) {
+  if (!w.dense.empty()) {
+    const size_t vsize = materialized_group::window_size / 32;
+    __m256i *c = (__m256i *)counters;
+    const __m256i *g = (const __m256i *)w.dense.data();
+    for (size_t i = 0; i < vsize; i++) {
+      _mm256_storeu_si256(c + i, _mm256_add_epi8(_mm256_loadu_si256(c + i),
+                                                 _mm256_loadu_si256(g + i)));
+    }
+  } else {
+    for (size_t j = 0; j < w.offsets.size(); j++)
+      counters[w.offsets[j]] += w.counts[j];
+  }
+}
+
+} // namespace
+
+// Same as fastscancount_avx2, counting the materialized groups as well as
+// the lists in data. Each value must occur fewer than 128 times in total.
+void fastscancount_groups(const std::vector<const materialized_group*> &groups,
+                          const std::vector<const std::vector<uint32_t>*> &data,
+                          std::vector<uint32_t> &out, uint8_t threshold) {
+  const size_t cache_size = materialized_group::window_size;
+  std::vector<uint8_t> counters(cache_size);
+  out.clear();
+
+  struct data_info {
+    const uint32_t *cur; // current pointer into data
+    const uint32_t *end; // pointer to end
+    uint32_t last;       // value of last element
+  };
+
+  std::vector<data_info> iter_data;
+  iter_data.reserve(data.size());
+  uint32_t largest = 0;
+  for (auto &d : data) {
+    if (d->empty())
+      continue;
+    iter_data.push_back({d->data(), d->data() + d->size(), d->back()});
+    largest = std::max(largest, d->back());
+  }
+  std::vector<size_t> group_iters(groups.size());
+  for (auto g : groups) {
+    if (!g->windows.empty())
+      largest = std::max(largest, g->windows.back().start + uint32_t(cache_size - 1));
+  }
+  if (iter_data.empty() && largest == 0)
+    return;
+  auto cdata = counters.data();
+  for (uint64_t start = 0; start <= largest; start += cache_size) {
+    memset(cdata, 0, cache_size * sizeof(counters[0]));
+    for (size_t k = 0; k < groups.size(); k++) {
+      const auto &windows = groups[k]->windows;
+      size_t &gi = group_iters[k];
+      if (gi < windows.size() && windows[gi].start == start) {
+        add_group_window(windows[gi], cdata);
+        gi++;
+      }
+    }
+    for (auto &id : iter_data) {
+      if (id.last >= start + cache_size) {
+        update_counters(id.cur, cdata - start, uint32_t(start + cache_size));
+      } else {
+        update_counters_final(id.cur, id.end, cdata - start);
+      }
+    }
+    populate_hits_avx(counters, cache_size, threshold, start, out);
+  }
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,143 @@
+#ifndef FASTSCANCOUNT_HISTOGRAM_H
+#define FASTSCANCOUNT_HISTOGRAM_H
+
+// this code expects an x64 processor with AVX2
+
+#include "fastscancount_avx2.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Computes, in one pass, how many values occur exactly k times for every k,
+// which gives the result size for every threshold at once. Optionally, the
+// values exceeding each of a set of thresholds are extracted in the same pass.
+
+namespace fastscancount {
+namespace {
+
+// above this many levels, the per-level SIMD comparisons cost more than
+// looking at the non-zero bytes one by one
+const size_t histogram_simd_levels = 16;
+
+uint8_t max_counter_avx(const uint8_t *array, size_t range) {
+  __m256i m = _mm256_setzero_si256();
+  for (size_t i = 0; i + 32 <= range; i += 32) {
+    m = _mm256_max_epu8(m, _mm256_loadu_si256((const __m256i *)(array + i)));
+  }
+  uint8_t buffer[32];
+  _mm256_storeu_si256((__m256i *)buffer, m);
+  uint8_t result = *std::max_element(buffer, buffer + 32);
+  for (size_t i = range / 32 * 32; i < range; i++)
+    result = std::max(result, array[i]);
+  return result;
+}
+
+// adds to hist[k] the number of counters equal to k, for k >= 1;
+// hist must have 256 entries
+void populate_histogram_avx(const uint8_t *array, size_t range,
+                            uint64_t *hist) {
+  const size_t levels = max_counter_avx(array, range);
+  if (levels == 0)
+    return;
+  const size_t vsize = range / 32;
+  if (levels <= histogram_simd_levels) {
+    __m256i acc[histogram_simd_levels];
+    __m256i level[histogram_simd_levels];
+    for (size_t k = 0; k < levels; k++)
+      level[k] = _mm256_set1_epi8(k + 1);
+    const __m256i zero = _mm256_setzero_si256();
+    // byte accumulators overflow after 255 iterations
+    for (size_t b = 0; b < vsize; b += 255) {
+      const size_t bend = std::min(vsize, b + 255);
+      for (size_t k = 0; k < levels; k++)
+        acc[k] = zero;
+      for (size_t i = b; i < bend; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)array + i);
+        for (size_t k = 0; k < levels; k++) {
+          // cmpeq gives -1 on equality
+          acc[k] = _mm256_sub_epi8(acc[k], _mm256_cmpeq_epi8(v, level[k]));
+        }
+      }
+      for (size_t k = 0; k < levels; k++) {
+        __m256i s = _mm256_sad_epu8(acc[k], zero);
+        hist[k + 1] += _mm256_extract_epi64(s, 0) + _mm256_extract_epi64(s, 1) +
+                       _mm256_extract_epi64(s, 2) + _mm256_extract_epi64(s, 3);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < vsize; i++) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)array + i);
+      if (_mm256_testz_si256(v, v))
+        continue;
+      for (size_t j = i * 32; j < i * 32 + 32; j++)
+        hist[array[j]]++;
+    }
+  }
+  for (size_t j = vsize * 32; j < range; j++)
+    hist[array[j]]++;
+  hist[0] = 0; // zero counters are not tracked
+}
+
+} // namespace
+
+// histogram[k] (256 entries) is the number of values that occur exactly k
+// times, so the number of hits for threshold t is the sum of histogram[k]
+// for k > t.
+// For each i, outs[i] receives the values occurring more than thresholds[i]
+// times, in sorted order. The AVX2 limit of fewer than 128 arrays applies.
+void fastscancount_histogram(const std::vector<const std::vector<uint32_t>*> &data,
+                             std::vector<uint64_t> &histogram,
+                             const std::vector<uint8_t> &thresholds,
+                             std::vector<std::vector<uint32_t>> &outs) {
+  const size_t cache_size = 65536;
+  std::vector<uint8_t> counters(cache_size);
+  histogram.assign(256, 0);
+  outs.resize(thresholds.size());
+  for (auto &o : outs)
+    o.clear();
+
+  struct data_info {
+    const uint32_t *cur; // current pointer into data
+    const uint32_t *end; // pointer to end
+    uint32_t last;       // value of last element
+  };
+
+  std::vector<data_info> iter_data;
+  iter_data.reserve(data.size());
+  uint32_t largest = 0;
+  for (auto &d : data) {
+    if (d->empty())
+      continue;
+    iter_data.push_back({d->data(), d->data() + d->size(), d->back()});
+    largest = std::max(largest, d->back());
+  }
+  if (iter_data.empty())
+    return;
+  auto cdata = counters.data();
+  for (uint64_t start = 0; start <= largest; start += cache_size) {
+    memset(cdata, 0, cache_size * sizeof(counters[0]));
+    for (auto &id : iter_data) {
+      if (id.last >= start + cache_size) {
+        update_counters(id.cur, cdata - start, uint32_t(start + cache_size));
+      } else {
+        update_counters_final(id.cur, id.end, cdata - start);
+      }
+    }
+    populate_histogram_avx(cdata, cache_size, histogram.data());
+    for (size_t t = 0; t < thresholds.size(); t++) {
+      populate_hits_avx(counters, cache_size, thresholds[t], start, outs[t]);
+    }
+  }
+}
+
+void fastscancount_histogram(const std::vector<const std::vector<uint32_t>*> &data,
+                             std::vector<uint64_t> &histogram) {
+  std::vector<std::vector<uint32_t>> outs;
+  fastscancount_histogram(data, histogram, {}, outs);
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,129 @@
+#ifndef FASTSCANCOUNT_HUGEPAGES_H
+#define FASTSCANCOUNT_HUGEPAGES_H
+
+// Allocation helpers that back large buffers (counters, outputs, postings)
+// with 2 MB pages so that random accesses do not thrash the dTLB.
+// Everything falls back to ordinary pages when huge pages are unavailable.
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define FASTSCANCOUNT_HAS_MMAP 1
+#endif
+
+namespace fastscancount {
+namespace {
+
+const size_t huge_page_size = 2 * 1024 * 1024;
+
+size_t round_to_huge_page(size_t bytes) {
+  return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+// Requests smaller than a huge page go to operator new. Larger requests
+// try explicit huge pages (MAP_HUGETLB) first, then a 2 MB aligned anonymous
+// mapping marked with MADV_HUGEPAGE, so that the kernel can still use
+// transparent huge pages when none are reserved.
+void *hugepage_alloc(size_t bytes) {
+#ifdef FASTSCANCOUNT_HAS_MMAP
+  if (bytes >= huge_page_size) {
+    const size_t len = round_to_huge_page(bytes);
+#ifdef MAP_HUGETLB
+    void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+      return p;
+#endif
+    // over-allocate so that we can trim to a 2 MB boundary
+    void *raw = mmap(nullptr, len + huge_page_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw != MAP_FAILED) {
+      uintptr_t b = (uintptr_t)raw;
+      uintptr_t a = (b + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1);
+      if (a > b)
+        munmap(raw, a - b);
+      munmap((void *)(a + len), b + huge_page_size - a);
+#ifdef MADV_HUGEPAGE
+      madvise((void *)a, len, MADV_HUGEPAGE);
+#endif
+      return (void *)a;
+    }
+    // hugepage_free must be able to munmap anything this large
+    throw std::bad_alloc();
+  }
+#endif
+  return ::operator new(bytes);
+}
+
+void hugepage_free(void *p, size_t bytes) {
+#ifdef FASTSCANCOUNT_HAS_MMAP
+  if (bytes >= huge_page_size) {
+    munmap(p, round_to_huge_page(bytes));
+    return;
+  }
+#endif
+  ::operator delete(p);
+}
+
+// Asks for transparent huge pages on the 2 MB aligned interior of an
+// existing buffer (e.g., the storage of a std::vector). This only helps
+// pages that have not been touched yet, so call it right after reserve().
+// It is a no-op when transparent huge pages are not supported.
+void advise_hugepages(void *p, size_t bytes) {
+#if defined(FASTSCANCOUNT_HAS_MMAP) && defined(MADV_HUGEPAGE)
+  uintptr_t b = (uintptr_t)p;
+  uintptr_t a = (b + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1);
+  uintptr_t e = (b + bytes) & ~(uintptr_t)(huge_page_size - 1);
+  if (e > a)
+    madvise((void *)a, e - a, MADV_HUGEPAGE);
+#else
+  (void)p;
+  (void)bytes;
+#endif
+}
+
+} // namespace
+
+// A standard allocator over hugepage_alloc, for instance:
+// std::vector<uint8_t, hugepage_allocator<uint8_t>> counters(largest + 1);
+template <typename T> struct hugepage_allocator {
+  typedef T value_type;
+
+  hugepage_allocator() = default;
+  template <typename U>
+  hugepage_allocator(const hugepage_allocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T))
+      throw std::bad_alloc();
+    return (T *)hugepage_alloc(n * sizeof(T));
+  }
+  void deallocate(T *p, size_t n) noexcept { hugepage_free(p, n * sizeof(T)); }
+
+  template <typename U>
+  bool operator==(const hugepage_allocator<U> &) const noexcept {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const hugepage_allocator<U> &) const noexcept {
+    return false;
+  }
+};
+
+template <typename T>
+using huge_vector = std::vector<T, hugepage_allocator<T>>;
+
+// Reserves room for n elements in v and asks for huge pages on the
+// new storage before it gets written to.
+template <typename T> void reserve_hugepages(std::vector<T> &v, size_t n) {
+  v.reserve(n);
+  advise_hugepages(v.data(), v.capacity() * sizeof(T));
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,179 @@
+#ifndef FASTSCANCOUNT_MERGE_H
+#define FASTSCANCOUNT_MERGE_H
+
+#ifdef __AVX2__
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+#include "fastscancount.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// With only a handful of lists, zeroing and scanning a window of counters
+// costs more than the actual work. This kernel uses no counters: it merges the
+// lists pairwise (with a bitonic merge network under AVX2) into one sorted
+// sequence where a value occurring c times forms a run of length c. A value
+// occurs more than threshold times exactly when the run starting at its first
+// position is long enough, that is when merged[i] == merged[i + threshold].
+// The output comes out sorted.
+
+namespace fastscancount {
+
+const size_t merge_max_lists = 8;
+
+namespace {
+
+#ifdef __AVX2__
+// v is bitonic, sorts it
+inline __m256i merge_bitonic_sort8(__m256i v) {
+  __m256i p = _mm256_permute2x128_si256(v, v, 1);
+  v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xF0);
+  p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+  v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xCC);
+  p = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+  v = _mm256_blend_epi32(_mm256_min_epu32(v, p), _mm256_max_epu32(v, p), 0xAA);
+  return v;
+}
+
+// a and b are sorted, lo receives the 8 smallest values and hi the 8 largest,
+// both sorted
+inline void merge_network8(__m256i a, __m256i b, __m256i &lo, __m256i &hi) {
+  b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+  lo = merge_bitonic_sort8(_mm256_min_epu32(a, b));
+  hi = merge_bitonic_sort8(_mm256_max_epu32(a, b));
+}
+#endif
+
+// writes the na + nb values of the sorted arrays a and b to out, in order
+void merge_pair(const uint32_t *a, size_t na, const uint32_t *b, size_t nb,
+                uint32_t *out) {
+#ifdef __AVX2__
+  if (na >= 8 && nb >= 8) {
+    __m256i lo, hi;
+    merge_network8(_mm256_loadu_si256((const __m256i *)a),
+                   _mm256_loadu_si256((const __m256i *)b), lo, hi);
+    _mm256_storeu_si256((__m256i *)out, lo);
+    out += 8;
+    size_t ia = 8, ib = 8;
+    // hi holds values no larger than the next value of either array, so we
+    // keep loading from the array with the smaller next value
+    while (ia + 8 <= na && ib + 8 <= nb) {
+      const uint32_t *next;
+      if (a[ia] <= b[ib]) {
+        next = a + ia;
+        ia += 8;
+      } else {
+        next = b + ib;
+        ib += 8;
+      }
+      merge_network8(_mm256_loadu_si256((const __m256i *)next), hi, lo, hi);
+      _mm256_storeu_si256((__m256i *)out, lo);
+      out += 8;
+    }
+    // at most 7 values are left in one of the arrays
+    uint32_t pending[8], small[15];
+    _mm256_storeu_si256((__m256i *)pending, hi);
+    const uint32_t *rest_short = a + ia, *rest_long = b + ib;
+    size_t short_size = na - ia, long_size = nb - ib;
+    if (short_size >= 8) {
+      std::swap(rest_short, rest_long);
+      std::swap(short_size, long_size);
+    }
+    uint32_t *small_end = std::merge(pending, pending + 8, rest_short,
+                                     rest_short + short_size, small);
+    std::merge(small, small_end, rest_long, rest_long + long_size, out);
+    return;
+  }
+#endif
+  std::merge(a, a + na, b, b + nb, out);
+}
+
+// the values of the sorted array m[0, n) that occur more than threshold times
+uint32_t *merge_runs(const uint32_t *m, size_t n, uint8_t threshold,
+                     uint32_t *out) {
+  if (n <= threshold)
+    return out;
+  if (m[0] == m[threshold])
+    *out++ = m[0];
+  size_t i = 1;
+#ifdef __AVX2__
+  for (; i + threshold + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(m + i));
+    __m256i ahead = _mm256_loadu_si256((const __m256i *)(m + i + threshold));
+    __m256i before = _mm256_loadu_si256((const __m256i *)(m + i - 1));
+    // first of its run, and the run is long enough
+    __m256i hit = _mm256_andnot_si256(_mm256_cmpeq_epi32(v, before),
+                                      _mm256_cmpeq_epi32(v, ahead));
+    uint32_t bits = uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(hit)));
+    for (; bits; bits &= bits - 1)
+      *out++ = m[i + __builtin_ctz(bits)];
+  }
+#endif
+  for (; i + threshold < n; i++) {
+    if (m[i] == m[i + threshold] && m[i] != m[i - 1])
+      *out++ = m[i];
+  }
+  return out;
+}
+
+} // namespace
+
+// Same result as fastscancount, in sorted order. The lists must not contain
+// duplicates. With more than merge_max_lists lists, this calls
+// fastscancount_sorted.
+void fastscancount_merge(const std::vector<const std::vector<uint32_t>*> &data,
+                         std::vector<uint32_t> &out, uint8_t threshold) {
+  if (data.size() > merge_max_lists) {
+    fastscancount_sorted(data, out, threshold);
+    return;
+  }
+  std::vector<std::pair<const uint32_t *, size_t>> runs, next;
+  size_t total = 0;
+  for (auto d : data) {
+    if (d->empty())
+      continue;
+    runs.emplace_back(d->data(), d->size());
+    total += d->size();
+  }
+  if (runs.size() <= threshold) {
+    out.clear();
+    return;
+  }
+  // merge pairwise until a single sequence is left, alternating buffers
+  std::vector<uint32_t> buffers[2];
+  for (int level = 0; runs.size() > 1; level ^= 1) {
+    buffers[level].resize(total);
+    uint32_t *dest = buffers[level].data();
+    next.clear();
+    for (size_t r = 0; r < runs.size(); r += 2) {
+      if (r + 1 == runs.size()) {
+        // odd one out, the other buffer may be overwritten at the next level
+        memcpy(dest, runs[r].first, runs[r].second * sizeof(uint32_t));
+        next.emplace_back(dest, runs[r].second);
+        break;
+      }
+      const size_t merged = runs[r].second + runs[r + 1].second;
+      merge_pair(runs[r].first, runs[r].second, runs[r + 1].first,
+                 runs[r + 1].second, dest);
+      next.emplace_back(dest, merged);
+      dest += merged;
+    }
+    runs.swap(next);
+  }
+  out.resize(total / (size_t(threshold) + 1) + 1);
+  uint32_t *output = merge_runs(runs[0].first, runs[0].second, threshold,
+                                out.data());
+  out.resize(output - out.data());
+}
+
+} // namespace fastscancount
+#endif
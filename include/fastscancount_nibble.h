@@ -0,0 +1,182 @@
+#ifndef FASTSCANCOUNT_NIBBLE_H
+#define FASTSCANCOUNT_NIBBLE_H
+
+#ifdef __AVX2__
+#include "fastscancount_avx2.h"
+#endif
+#include "fastscancount.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Variants of fastscancount and fastscancount_avx2 with 4-bit counters: the
+// counter of value v is the low nibble of byte v / 2 when v is even, and the
+// high nibble otherwise. For thresholds up to 14, a counter never needs to go
+// beyond 15, so twice as many values fit in the same cache and there are half
+// as many windows. With more than 15 lists, the counters saturate at 15
+// instead of spilling into their neighbour.
+
+namespace fastscancount {
+
+const uint8_t nibble_max_threshold = 14;
+
+namespace {
+
+// increments the counter of val; with Emit, writes val to out when the counter
+// reaches threshold + 1
+template <bool Saturate, bool Emit>
+inline uint32_t *nibble_increment(uint8_t *deccounters, uint32_t val,
+                                  uint8_t threshold, uint32_t *out) {
+  uint8_t *location = deccounters + (val >> 1);
+  const int shift = (val & 1) << 2;
+  const uint8_t c = *location;
+  const uint8_t count = (c >> shift) & 15;
+  if (Emit && count == threshold)
+    *out++ = val;
+  *location = Saturate ? uint8_t(c + (uint8_t(count != 15) << shift))
+                       : uint8_t(c + (1 << shift));
+  return out;
+}
+
+// counts the values of [it, ...) that are below range_end, or up to end when
+// the list finishes within the window; with Emit, writes the values reaching
+// threshold + 1 to out
+template <bool Saturate, bool Emit>
+uint32_t *nibble_count(const uint32_t *&it_, const uint32_t *end, uint32_t last,
+                       uint8_t *deccounters, uint64_t range_end,
+                       uint8_t threshold, uint32_t *out) {
+  const uint32_t *it = it_;
+  if (last >= range_end) {
+    // an element >= range_end ends the loop, no need to check for the end
+    for (uint32_t val = *it; val < range_end; val = *++it)
+      out = nibble_increment<Saturate, Emit>(deccounters, val, threshold, out);
+  } else {
+    for (; it != end; it++)
+      out = nibble_increment<Saturate, Emit>(deccounters, *it, threshold, out);
+  }
+  it_ = it;
+  return out;
+}
+
+template <bool Saturate, bool Emit>
+void nibble_windows(const std::vector<const std::vector<uint32_t>*> &data,
+                    std::vector<uint32_t> &out, uint8_t threshold, size_t range,
+                    void (*extract)(const uint8_t *, size_t, uint8_t, size_t,
+                                    std::vector<uint32_t> &)) {
+  // range is even, so that a window starts with a low nibble
+  std::vector<uint8_t> counters(range / 2);
+  struct data_info {
+    const uint32_t *cur;
+    const uint32_t *end;
+    uint32_t last;
+  };
+  std::vector<data_info> iter_data;
+  uint32_t largest = 0;
+  for (auto d : data) {
+    if (d->empty())
+      continue;
+    iter_data.push_back({d->data(), d->data() + d->size(), d->back()});
+    largest = std::max(largest, d->back());
+  }
+  out.clear();
+  uint32_t *output = out.data();
+  if (Emit) {
+    out.resize(4 * range); // let us add lots of capacity
+    output = out.data();
+  }
+  for (size_t start = 0; !iter_data.empty() && start <= largest; start += range) {
+    if (Emit) {
+      // make sure that the capacity is sufficient
+      size_t countsofar = output - out.data();
+      if (out.size() - countsofar < range) {
+        out.resize(out.size() + 4 * range);
+        output = out.data() + countsofar;
+      }
+    }
+    memset(counters.data(), 0, counters.size());
+    uint8_t *const deccounters = counters.data() - start / 2;
+    for (auto &id : iter_data) {
+      if (id.cur == id.end)
+        continue;
+      output = nibble_count<Saturate, Emit>(id.cur, id.end, id.last, deccounters,
+                                            start + range, threshold, output);
+    }
+    if (!Emit)
+      extract(counters.data(), counters.size(), threshold, start, out);
+  }
+  if (Emit)
+    out.resize(output - out.data());
+}
+
+#ifdef __AVX2__
+// appends the values whose 4-bit counter exceeds threshold, in order; bytes
+// must be a multiple of 32
+void populate_hits_nibble_avx2(const uint8_t *counters, size_t bytes,
+                               uint8_t threshold, size_t start,
+                               std::vector<uint32_t> &out) {
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0F);
+  const __m256i t = _mm256_set1_epi8(char(threshold));
+  for (size_t i = 0; i < bytes; i += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)(counters + i));
+    const __m256i even = _mm256_and_si256(v, low_nibbles);
+    const __m256i odd = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+    if (_mm256_testz_si256(_mm256_cmpgt_epi8(_mm256_max_epu8(even, odd), t),
+                           _mm256_set1_epi8(-1)))
+      continue; // nothing in these 64 values
+    const __m256i he = _mm256_cmpgt_epi8(even, t);
+    const __m256i ho = _mm256_cmpgt_epi8(odd, t);
+    // interleave back into value order: unpack works within 128-bit lanes
+    const __m256i lo = _mm256_unpacklo_epi8(he, ho);
+    const __m256i hi = _mm256_unpackhi_epi8(he, ho);
+    const uint64_t first = uint32_t(_mm256_movemask_epi8(
+        _mm256_permute2x128_si256(lo, hi, 0x20)));
+    const uint64_t second = uint32_t(_mm256_movemask_epi8(
+        _mm256_permute2x128_si256(lo, hi, 0x31)));
+    const uint32_t base = uint32_t(start + 2 * i);
+    for (uint64_t bits = first | (second << 32); bits; bits &= bits - 1)
+      out.push_back(base + uint32_t(__builtin_ctzll(bits)));
+  }
+}
+#endif
+
+} // namespace
+
+// Same result as fastscancount. With a threshold above nibble_max_threshold,
+// this calls fastscancount.
+void fastscancount_nibble(const std::vector<const std::vector<uint32_t>*> &data,
+                          std::vector<uint32_t> &out, uint8_t threshold) {
+  if (threshold > nibble_max_threshold) {
+    fastscancount(data, out, threshold);
+    return;
+  }
+  const size_t range = 2 * 65536; // 64 KB of counters, as in fastscancount
+  if (data.size() > 15) {
+    nibble_windows<true, true>(data, out, threshold, range, nullptr);
+  } else {
+    nibble_windows<false, true>(data, out, threshold, range, nullptr);
+  }
+}
+
+#ifdef __AVX2__
+// Same result as fastscancount_avx2, in sorted order. With a threshold above
+// nibble_max_threshold, this calls fastscancount_avx2.
+void fastscancount_nibble_avx2(const std::vector<const std::vector<uint32_t>*> &data,
+                               std::vector<uint32_t> &out, uint8_t threshold) {
+  if (threshold > nibble_max_threshold) {
+    fastscancount_avx2(data, out, threshold);
+    return;
+  }
+  const size_t range = 2 * 40000; // 40000 bytes of counters, as in fastscancount_avx2
+  if (data.size() > 15) {
+    nibble_windows<true, false>(data, out, threshold, range, populate_hits_nibble_avx2);
+  } else {
+    nibble_windows<false, false>(data, out, threshold, range, populate_hits_nibble_avx2);
+  }
+}
+#endif
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,109 @@
+#ifndef FASTSCANCOUNT_PREFETCH_H
+#define FASTSCANCOUNT_PREFETCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Variant of fastscancount for queries with many long lists: instead of
+// draining each list to the end of the window before moving to the next one,
+// we visit the lists round-robin, a chunk at a time, and prefetch ahead in
+// each of them. This keeps many memory streams in flight even when there are
+// more lists than the hardware prefetcher can track.
+
+namespace fastscancount {
+namespace {
+
+struct prefetch_stream {
+  const uint32_t *cur; // current pointer into data
+  const uint32_t *end; // pointer to end
+};
+
+// processes up to chunk elements of s that are smaller than range_end,
+// returns false if s is done with the current window
+bool prefetch_count_chunk(prefetch_stream &s, uint8_t *counters,
+                          uint64_t range_end, size_t chunk,
+                          size_t prefetch_distance, uint8_t threshold,
+                          uint32_t *&out) {
+  const uint32_t *it = s.cur;
+  const uint32_t *stop = it + std::min(chunk, size_t(s.end - it));
+  // one prefetch per 64-byte cache line of the chunk that is
+  // prefetch_distance elements ahead, but not beyond the end of the list
+  for (const uint32_t *p = it; p < stop; p += 16) {
+    __builtin_prefetch(size_t(s.end - p) > prefetch_distance ? p + prefetch_distance : s.end);
+  }
+  uint32_t *o = out;
+  for (; it != stop; ++it) {
+    uint32_t val = *it;
+    if (val >= range_end)
+      break;
+    uint8_t c = counters[val];
+    if (c == threshold)
+      *o++ = val;
+    counters[val] = c + 1;
+  }
+  out = o;
+  s.cur = it;
+  return (it == stop) && (it != s.end);
+}
+
+} // namespace
+
+// prefetch_distance is expressed in elements (uint32_t) and chunk is the
+// number of elements consumed from a list before switching to the next one.
+void fastscancount_prefetch(
+    const std::vector<const std::vector<uint32_t> *> &data,
+    std::vector<uint32_t> &out, uint8_t threshold,
+    size_t prefetch_distance = 512, size_t chunk = 64) {
+  const size_t range = 65536;
+  std::vector<uint8_t> counters(range);
+  out.clear();
+  if (chunk == 0)
+    chunk = 1;
+  std::vector<prefetch_stream> streams;
+  streams.reserve(data.size());
+  uint32_t largest = 0;
+  for (auto d : data) {
+    if (d->empty())
+      continue;
+    streams.push_back({d->data(), d->data() + d->size()});
+    largest = std::max(largest, d->back());
+  }
+  if (streams.empty())
+    return;
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  std::vector<size_t> active(streams.size());
+  for (size_t start = 0; start <= largest; start += range) {
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    uint8_t *deccounters = counters.data() - start;
+    const uint64_t range_end = start + range;
+    size_t nactive = 0;
+    for (size_t c = 0; c < streams.size(); c++) {
+      if (streams[c].cur != streams[c].end)
+        active[nactive++] = c;
+    }
+    while (nactive > 0) {
+      size_t kept = 0;
+      for (size_t a = 0; a < nactive; a++) {
+        size_t c = active[a];
+        if (prefetch_count_chunk(streams[c], deccounters, range_end, chunk,
+                                 prefetch_distance, threshold, output))
+          active[kept++] = c;
+      }
+      nactive = kept;
+    }
+  }
+  out.resize(output - out.data());
+}
+
+} // namespace fastscancount
+#endif
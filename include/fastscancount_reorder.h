@@ -0,0 +1,185 @@
+#ifndef FASTSCANCOUNT_REORDER_H
+#define FASTSCANCOUNT_REORDER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Doc-id reordering by recursive graph bisection (Dhulipala et al., KDD 2016).
+// The documents are split in two halves, and documents are swapped between
+// the halves while this lowers the estimated cost of the gaps, d log(n / d)
+// per list and half; then each half is split in turn. Documents that share
+// lists end up with close ids, so the hits of a query fall in fewer windows
+// and the lists have longer runs. This is meant to be done offline, once.
+
+namespace fastscancount {
+
+namespace {
+
+struct bisection_state {
+  std::vector<uint32_t> doc_begin;  // terms of document d: doc_terms[doc_begin[d]...]
+  std::vector<uint32_t> doc_terms;
+  std::vector<uint32_t> left_degree; // per term, within the current partition
+  std::vector<uint32_t> right_degree;
+  std::vector<float> left_gain;      // per term, for moving a document out of the left half
+  std::vector<float> right_gain;
+  std::vector<uint32_t> touched;     // terms of the current partition
+  std::vector<std::pair<float, uint32_t>> left, right;
+  size_t iterations;
+  size_t min_partition;
+};
+
+inline float bisection_cost(uint32_t degree, uint32_t n) {
+  return degree == 0 ? 0.0f : degree * std::log2(float(n) / (degree + 1));
+}
+
+void bisect(bisection_state &s, uint32_t *docs, size_t n) {
+  if (n < 2 * s.min_partition) {
+    std::sort(docs, docs + n); // within a leaf, keep the original order
+    return;
+  }
+  const size_t half = n / 2;
+  const uint32_t nl = uint32_t(half), nr = uint32_t(n - half);
+  s.touched.clear();
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t d = docs[i];
+    for (uint32_t k = s.doc_begin[d]; k < s.doc_begin[d + 1]; k++) {
+      const uint32_t t = s.doc_terms[k];
+      if (s.left_degree[t] == 0 && s.right_degree[t] == 0)
+        s.touched.push_back(t);
+      (i < half ? s.left_degree : s.right_degree)[t]++;
+    }
+  }
+  auto gain = [&s](uint32_t d, const std::vector<float> &per_term) {
+    float g = 0;
+    for (uint32_t k = s.doc_begin[d]; k < s.doc_begin[d + 1]; k++)
+      g += per_term[s.doc_terms[k]];
+    return g;
+  };
+  for (size_t it = 0; it < s.iterations; it++) {
+    for (uint32_t t : s.touched) {
+      const uint32_t dl = s.left_degree[t], dr = s.right_degree[t];
+      const float now = bisection_cost(dl, nl) + bisection_cost(dr, nr);
+      s.left_gain[t] = dl == 0 ? 0.0f : now - bisection_cost(dl - 1, nl) - bisection_cost(dr + 1, nr);
+      s.right_gain[t] = dr == 0 ? 0.0f : now - bisection_cost(dl + 1, nl) - bisection_cost(dr - 1, nr);
+    }
+    s.left.clear();
+    s.right.clear();
+    for (size_t i = 0; i < half; i++)
+      s.left.push_back({gain(docs[i], s.left_gain), docs[i]});
+    for (size_t i = half; i < n; i++)
+      s.right.push_back({gain(docs[i], s.right_gain), docs[i]});
+    auto larger_gain = [](const std::pair<float, uint32_t> &a,
+                          const std::pair<float, uint32_t> &b) {
+      return a.first > b.first;
+    };
+    std::sort(s.left.begin(), s.left.end(), larger_gain);
+    std::sort(s.right.begin(), s.right.end(), larger_gain);
+    size_t swaps = 0;
+    while (swaps < s.left.size() && swaps < s.right.size() &&
+           s.left[swaps].first + s.right[swaps].first > 0) {
+      const uint32_t from_left = s.left[swaps].second, from_right = s.right[swaps].second;
+      for (uint32_t k = s.doc_begin[from_left]; k < s.doc_begin[from_left + 1]; k++) {
+        s.left_degree[s.doc_terms[k]]--;
+        s.right_degree[s.doc_terms[k]]++;
+      }
+      for (uint32_t k = s.doc_begin[from_right]; k < s.doc_begin[from_right + 1]; k++) {
+        s.right_degree[s.doc_terms[k]]--;
+        s.left_degree[s.doc_terms[k]]++;
+      }
+      std::swap(s.left[swaps].second, s.right[swaps].second);
+      swaps++;
+    }
+    for (size_t i = 0; i < half; i++)
+      docs[i] = s.left[i].second;
+    for (size_t i = half; i < n; i++)
+      docs[i] = s.right[i - half].second;
+    if (swaps == 0)
+      break;
+  }
+  for (uint32_t t : s.touched) {
+    s.left_degree[t] = 0;
+    s.right_degree[t] = 0;
+  }
+  bisect(s, docs, half);
+  bisect(s, docs + half, n - half);
+}
+
+} // namespace
+
+// Computes a permutation of the document ids of the sorted lists: document d
+// becomes new_id[d]. The documents found in none of the lists of at least two
+// documents keep their relative order and get the last ids. iterations bounds
+// the number of rounds of swaps per bisection, and partitions with fewer than
+// 2 * min_partition documents are not split.
+std::vector<uint32_t> bisection_order(const std::vector<std::vector<uint32_t>> &lists,
+                                      size_t iterations = 20,
+                                      size_t min_partition = 16) {
+  uint64_t universe = 0;
+  for (const auto &v : lists) {
+    if (!v.empty())
+      universe = std::max<uint64_t>(universe, uint64_t(v.back()) + 1);
+  }
+  size_t postings = 0;
+  bisection_state s;
+  s.iterations = iterations;
+  s.min_partition = std::max<size_t>(min_partition, 1);
+  // forward index: the lists of each document, leaving out the lists of a
+  // single document, which have no gaps to shrink
+  s.doc_begin.assign(universe + 1, 0);
+  for (const auto &v : lists) {
+    if (v.size() < 2)
+      continue;
+    for (uint32_t d : v)
+      s.doc_begin[d + 1]++;
+    postings += v.size();
+  }
+  if (postings > UINT32_MAX)
+    throw std::runtime_error("too many postings for 32-bit offsets");
+  for (size_t d = 0; d < universe; d++)
+    s.doc_begin[d + 1] += s.doc_begin[d];
+  s.doc_terms.resize(postings);
+  {
+    std::vector<uint32_t> fill(s.doc_begin.begin(), s.doc_begin.end() - 1);
+    for (size_t t = 0; t < lists.size(); t++) {
+      if (lists[t].size() < 2)
+        continue;
+      for (uint32_t d : lists[t])
+        s.doc_terms[fill[d]++] = uint32_t(t);
+    }
+  }
+  s.left_degree.assign(lists.size(), 0);
+  s.right_degree.assign(lists.size(), 0);
+  s.left_gain.assign(lists.size(), 0);
+  s.right_gain.assign(lists.size(), 0);
+  std::vector<uint32_t> order, rest;
+  for (size_t d = 0; d < universe; d++) {
+    (s.doc_begin[d + 1] > s.doc_begin[d] ? order : rest).push_back(uint32_t(d));
+  }
+  bisect(s, order.data(), order.size());
+  order.insert(order.end(), rest.begin(), rest.end());
+  std::vector<uint32_t> new_id(universe);
+  for (size_t i = 0; i < order.size(); i++)
+    new_id[order[i]] = uint32_t(i);
+  return new_id;
+}
+
+// Renames the documents of the lists according to new_id, and sorts the lists.
+void remap_lists(std::vector<std::vector<uint32_t>> &lists,
+                 const std::vector<uint32_t> &new_id) {
+  for (auto &v : lists) {
+    for (uint32_t &d : v) {
+      if (d >= new_id.size())
+        throw std::out_of_range("document without a new id");
+      d = new_id[d];
+    }
+    std::sort(v.begin(), v.end());
+  }
+}
+
+} // namespace fastscancount
+#endif
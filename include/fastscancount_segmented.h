@@ -0,0 +1,210 @@
+#ifndef FASTSCANCOUNT_SEGMENTED_H
+#define FASTSCANCOUNT_SEGMENTED_H
+
+#include "fastscancount.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// An index that keeps growing, in the style of a log-structured merge tree.
+// New documents go to a small mutable segment; when it is full, it is sealed
+// into an immutable segment, and a background thread merges adjacent
+// segments when there are too many of them. Documents are added in
+// increasing doc-id order, so the postings of a term in a segment all come
+// after those in older segments: a term is a sequence of sorted slices, one
+// per segment, and a query simply gives every (term, segment) slice to the
+// kernels as a separate list. A document is in a single segment, so the counts
+// are the same as with one list per term.
+
+namespace fastscancount {
+
+class segmented_index {
+public:
+  struct segment {
+    std::vector<std::vector<uint32_t>> lists; // per term, possibly empty
+    size_t postings = 0;
+  };
+
+  // The lists of a query, valid as long as the object lives even if the
+  // index is compacted meanwhile.
+  struct query_lists {
+    std::vector<const std::vector<uint32_t> *> lists; // non-empty slices
+    std::vector<std::shared_ptr<const segment>> pinned;
+    std::vector<std::vector<uint32_t>> recent; // copied from the mutable segment
+  };
+
+  // The mutable segment is sealed once it holds mutable_limit postings, and
+  // segments are merged while there are more than max_segments.
+  segmented_index(size_t term_count, size_t mutable_limit = 1 << 20,
+                  size_t max_segments = 8)
+      : term_count(term_count), mutable_limit(std::max<size_t>(mutable_limit, 1)),
+        max_segments(std::max<size_t>(max_segments, 1)) {
+    current.lists.resize(term_count);
+    compactor = std::thread([this]() { compaction_loop(); });
+  }
+
+  segmented_index(const segmented_index &) = delete;
+  segmented_index &operator=(const segmented_index &) = delete;
+
+  ~segmented_index() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    work.notify_all();
+    compactor.join();
+  }
+
+  // doc must be larger than any document added before
+  void add_document(uint32_t doc, const std::vector<uint32_t> &terms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (any_document && doc <= last_document)
+      throw std::invalid_argument("documents must be added in increasing order");
+    for (uint32_t t : terms) {
+      if (t >= term_count)
+        throw std::out_of_range("no such term");
+    }
+    for (uint32_t t : terms) {
+      std::vector<uint32_t> &v = current.lists[t];
+      if (v.empty() || v.back() != doc) { // a repeated term counts once
+        v.push_back(doc);
+        current.postings++;
+      }
+    }
+    any_document = true;
+    last_document = doc;
+    if (current.postings >= mutable_limit)
+      seal();
+  }
+
+  // seals the mutable segment, so that the next compaction can take it
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (current.postings > 0)
+      seal();
+  }
+
+  // blocks until there are at most max_segments segments
+  void wait_for_compaction() {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return segments.size() <= max_segments; });
+  }
+
+  void lists_for(const std::vector<uint32_t> &terms, query_lists &q) const {
+    q.lists.clear();
+    q.recent.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    q.pinned = segments;
+    for (uint32_t t : terms) {
+      if (t >= term_count)
+        throw std::out_of_range("no such term");
+      if (!current.lists[t].empty())
+        q.recent.push_back(current.lists[t]);
+    }
+    for (uint32_t t : terms) {
+      for (const auto &s : q.pinned) {
+        if (!s->lists[t].empty())
+          q.lists.push_back(&s->lists[t]);
+      }
+    }
+    for (const auto &v : q.recent)
+      q.lists.push_back(&v);
+  }
+
+  size_t segment_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return segments.size();
+  }
+
+  size_t merge_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return merges;
+  }
+
+private:
+  // with the mutex held
+  void seal() {
+    auto s = std::make_shared<segment>();
+    s->lists.swap(current.lists);
+    s->postings = current.postings;
+    current.lists.assign(term_count, {});
+    current.postings = 0;
+    segments.push_back(std::move(s));
+    if (segments.size() > max_segments)
+      work.notify_one();
+  }
+
+  void compaction_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      work.wait(lock, [this]() {
+        return stopping || segments.size() > max_segments;
+      });
+      if (stopping)
+        return;
+      // merge the adjacent pair with the fewest postings; only this thread
+      // removes segments, so their positions stay valid while unlocked
+      size_t best = 0;
+      for (size_t i = 1; i + 1 < segments.size(); i++) {
+        if (segments[i]->postings + segments[i + 1]->postings <
+            segments[best]->postings + segments[best + 1]->postings)
+          best = i;
+      }
+      std::shared_ptr<const segment> older = segments[best];
+      std::shared_ptr<const segment> newer = segments[best + 1];
+      lock.unlock();
+      auto merged = std::make_shared<segment>();
+      merged->lists.resize(term_count);
+      for (size_t t = 0; t < term_count; t++) {
+        const std::vector<uint32_t> &a = older->lists[t], &b = newer->lists[t];
+        merged->lists[t].reserve(a.size() + b.size());
+        merged->lists[t].insert(merged->lists[t].end(), a.begin(), a.end());
+        merged->lists[t].insert(merged->lists[t].end(), b.begin(), b.end());
+      }
+      merged->postings = older->postings + newer->postings;
+      lock.lock();
+      segments[best] = std::move(merged);
+      segments.erase(segments.begin() + best + 1);
+      merges++;
+      done.notify_all();
+    }
+  }
+
+  const size_t term_count;
+  const size_t mutable_limit;
+  const size_t max_segments;
+
+  mutable std::mutex mutex;
+  std::condition_variable work; // there are too many segments, or stopping
+  std::condition_variable done; // a merge completed
+  std::vector<std::shared_ptr<const segment>> segments; // oldest first
+  segment current;                                      // the mutable segment
+  bool any_document = false;
+  uint32_t last_document = 0;
+  size_t merges = 0;
+  bool stopping = false;
+  std::thread compactor;
+};
+
+// Same result as fastscancount over the lists of the terms.
+void fastscancount_segmented(const segmented_index &index,
+                             const std::vector<uint32_t> &terms,
+                             std::vector<uint32_t> &out, uint8_t threshold) {
+  segmented_index::query_lists q;
+  index.lists_for(terms, q);
+  if (q.lists.empty()) {
+    out.clear();
+    return;
+  }
+  fastscancount(q.lists, out, threshold);
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,338 @@
+#ifndef FASTSCANCOUNT_SHARD_H
+#define FASTSCANCOUNT_SHARD_H
+
+// this code expects a POSIX system
+
+#include "fastscancount.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Serving from several processes. The postings are published once in a POSIX
+// shared memory object, where the doc-id space is cut into shards (whole
+// windows of 65536 values) and the postings are stored shard after shard, so
+// that each (shard, list) slice is contiguous. Every worker process maps the
+// object read-only and counts its own shard; shard_pool sends each query to
+// all the workers over Unix sockets and concatenates their hits.
+
+namespace fastscancount {
+
+class shared_index {
+public:
+  static const uint64_t magic_number = 0x5343414e53484d31ULL; // "SCANSHM1"
+  static const uint64_t shard_alignment = 65536;
+
+  // Creates (or replaces) the shared memory object 'name', e.g.
+  // "/fastscancount", holding the lists cut into 'shards' shards.
+  static void publish(const std::string &name,
+                      const std::vector<std::vector<uint32_t>> &lists,
+                      uint32_t shards) {
+    if (shards == 0)
+      throw std::runtime_error("shards must be > 0");
+    uint64_t universe = 1, total = 0;
+    for (const auto &v : lists) {
+      if (!v.empty())
+        universe = std::max<uint64_t>(universe, uint64_t(v.back()) + 1);
+      total += v.size();
+    }
+    uint64_t width = (universe + shards - 1) / shards;
+    width = (width + shard_alignment - 1) / shard_alignment * shard_alignment;
+    const size_t entries = size_t(shards) * lists.size() + 1;
+    const uint64_t bytes = sizeof(header) + entries * sizeof(uint64_t) +
+                           total * sizeof(uint32_t);
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0)
+      throw std::runtime_error("shm_open " + name + ": " + strerror(errno));
+    if (::ftruncate(fd, off_t(bytes)) != 0) {
+      ::close(fd);
+      throw std::runtime_error("ftruncate " + name + ": " + strerror(errno));
+    }
+    void *p = ::mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+      throw std::runtime_error("mmap " + name + ": " + strerror(errno));
+    header *h = (header *)p;
+    h->magic = magic_number;
+    h->bytes = bytes;
+    h->list_count = uint32_t(lists.size());
+    h->shard_count = shards;
+    h->shard_width = width;
+    uint64_t *offsets = (uint64_t *)(h + 1);
+    uint32_t *postings = (uint32_t *)(offsets + entries);
+    std::vector<size_t> pos(lists.size());
+    uint64_t written = 0;
+    for (uint32_t s = 0; s < shards; s++) {
+      const uint64_t shard_end = (s + 1) * width;
+      for (size_t t = 0; t < lists.size(); t++) {
+        offsets[s * lists.size() + t] = written;
+        const std::vector<uint32_t> &v = lists[t];
+        size_t i = pos[t];
+        while (i < v.size() && v[i] < shard_end)
+          postings[written++] = v[i++];
+        pos[t] = i;
+      }
+    }
+    offsets[entries - 1] = written;
+    ::munmap(p, bytes);
+  }
+
+  static void unlink(const std::string &name) { ::shm_unlink(name.c_str()); }
+
+  // Maps the object 'name', read-only.
+  explicit shared_index(const std::string &name) {
+    int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      throw std::runtime_error("shm_open " + name + ": " + strerror(errno));
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header)) {
+      ::close(fd);
+      throw std::runtime_error("not a shared index: " + name);
+    }
+    mapped_bytes = size_t(st.st_size);
+    base = ::mmap(NULL, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+      throw std::runtime_error("mmap " + name + ": " + strerror(errno));
+    h = (const header *)base;
+    if (h->magic != magic_number || h->bytes != mapped_bytes) {
+      ::munmap(base, mapped_bytes);
+      throw std::runtime_error("not a shared index: " + name);
+    }
+    offsets = (const uint64_t *)(h + 1);
+    postings = (const uint32_t *)(offsets + size_t(h->shard_count) * h->list_count + 1);
+  }
+
+  shared_index(const shared_index &) = delete;
+  shared_index &operator=(const shared_index &) = delete;
+
+  ~shared_index() { ::munmap(base, mapped_bytes); }
+
+  uint32_t list_count() const { return h->list_count; }
+  uint32_t shard_count() const { return h->shard_count; }
+  size_t bytes() const { return mapped_bytes; }
+  // the shard holds the values in [shard_begin(s), shard_begin(s + 1))
+  uint64_t shard_begin(uint32_t shard) const { return shard * h->shard_width; }
+
+  // the values of a list within a shard
+  const uint32_t *slice(uint32_t shard, uint32_t list, size_t &count) const {
+    if (shard >= h->shard_count || list >= h->list_count)
+      throw std::out_of_range("no such shard or list");
+    const size_t e = size_t(shard) * h->list_count + list;
+    count = size_t(offsets[e + 1] - offsets[e]);
+    return postings + offsets[e];
+  }
+
+private:
+  struct header {
+    uint64_t magic;
+    uint64_t bytes;
+    uint32_t list_count;
+    uint32_t shard_count;
+    uint64_t shard_width;
+  };
+
+  void *base;
+  size_t mapped_bytes;
+  const header *h;
+  const uint64_t *offsets; // shard-major, shard_count * list_count + 1 entries
+  const uint32_t *postings;
+};
+
+// Same result as fastscancount, restricted to the values of one shard.
+void fastscancount_shard(const shared_index &index, uint32_t shard,
+                         const std::vector<uint32_t> &lists,
+                         std::vector<uint32_t> &out, uint8_t threshold) {
+  const size_t range = 65536;
+  std::vector<uint8_t> counters(range);
+  struct cursor {
+    const uint32_t *d;
+    size_t it;
+    size_t end;
+  };
+  std::vector<cursor> cursors;
+  uint64_t largest = 0;
+  for (uint32_t t : lists) {
+    size_t count;
+    const uint32_t *d = index.slice(shard, t, count);
+    if (count == 0)
+      continue;
+    cursors.push_back({d, 0, count});
+    largest = std::max<uint64_t>(largest, d[count - 1]);
+  }
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  for (uint64_t start = index.shard_begin(shard);
+       !cursors.empty() && start <= largest; start += range) {
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    for (cursor &c : cursors) {
+      if (c.it == c.end)
+        continue;
+      if (c.d[c.end - 1] < start + range) {
+        output = natefastscancount_finalcheck(counters.data(), c.it, c.d, start,
+                                              c.end, threshold, output);
+      } else {
+        output = natefastscancount_maincheck(counters.data(), c.it, c.d, start,
+                                             range, threshold, output);
+      }
+    }
+  }
+  out.resize(output - out.data());
+}
+
+namespace {
+
+void shard_send(int fd, const void *buf, size_t bytes) {
+  const char *p = (const char *)buf;
+  while (bytes > 0) {
+    ssize_t w = ::send(fd, p, bytes, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0)
+      throw std::runtime_error(std::string("send: ") + strerror(errno));
+    p += w;
+    bytes -= w;
+  }
+}
+
+// returns false if the peer closed the socket before sending anything
+bool shard_receive(int fd, void *buf, size_t bytes) {
+  char *p = (char *)buf;
+  const size_t expected = bytes;
+  while (bytes > 0) {
+    ssize_t r = ::recv(fd, p, bytes, 0);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r == 0 && bytes == expected)
+      return false;
+    if (r <= 0)
+      throw std::runtime_error(r == 0 ? "shard connection closed"
+                                      : std::string("recv: ") + strerror(errno));
+    p += r;
+    bytes -= r;
+  }
+  return true;
+}
+
+// a request is (threshold, number of lists, list ids...), all 32-bit, and
+// the reply is a 64-bit hit count followed by the hits
+void shard_worker(const std::string &name, uint32_t shard, int fd) {
+  shared_index index(name);
+  std::vector<uint32_t> lists, hits;
+  uint32_t head[2];
+  while (shard_receive(fd, head, sizeof(head))) {
+    lists.resize(head[1]);
+    if (!shard_receive(fd, lists.data(), lists.size() * sizeof(uint32_t)) &&
+        !lists.empty())
+      return;
+    fastscancount_shard(index, shard, lists, hits, uint8_t(head[0]));
+    const uint64_t count = hits.size();
+    shard_send(fd, &count, sizeof(count));
+    shard_send(fd, hits.data(), hits.size() * sizeof(uint32_t));
+  }
+}
+
+} // namespace
+
+// One worker process per shard of the index published as 'name'. The workers
+// are forked, so create the pool before starting any thread.
+class shard_pool {
+public:
+  explicit shard_pool(const std::string &name) {
+    const uint32_t shards = shared_index(name).shard_count();
+    for (uint32_t s = 0; s < shards; s++) {
+      int sv[2];
+      if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        shutdown();
+        throw std::runtime_error(std::string("socketpair: ") + strerror(errno));
+      }
+      pid_t pid = ::fork();
+      if (pid < 0) {
+        ::close(sv[0]);
+        ::close(sv[1]);
+        shutdown();
+        throw std::runtime_error(std::string("fork: ") + strerror(errno));
+      }
+      if (pid == 0) {
+        ::close(sv[0]);
+        for (int fd : sockets)
+          ::close(fd);
+        int status = 0;
+        try {
+          shard_worker(name, s, sv[1]);
+        } catch (...) {
+          status = 1;
+        }
+        ::_exit(status);
+      }
+      ::close(sv[1]);
+      sockets.push_back(sv[0]);
+      workers.push_back(pid);
+    }
+  }
+
+  shard_pool(const shard_pool &) = delete;
+  shard_pool &operator=(const shard_pool &) = delete;
+
+  ~shard_pool() { shutdown(); }
+
+  size_t size() const { return workers.size(); }
+
+  // Same result as fastscancount: the hits of shard 0, then those of shard 1,
+  // and so forth.
+  void query(const std::vector<uint32_t> &lists, std::vector<uint32_t> &out,
+             uint8_t threshold) {
+    request.resize(2 + lists.size());
+    request[0] = threshold;
+    request[1] = uint32_t(lists.size());
+    std::copy(lists.begin(), lists.end(), request.begin() + 2);
+    // all the workers start before we wait for the first one
+    for (int fd : sockets)
+      shard_send(fd, request.data(), request.size() * sizeof(uint32_t));
+    out.clear();
+    for (int fd : sockets) {
+      uint64_t count;
+      if (!shard_receive(fd, &count, sizeof(count)))
+        throw std::runtime_error("shard worker exited");
+      const size_t old = out.size();
+      out.resize(old + count);
+      shard_receive(fd, out.data() + old, count * sizeof(uint32_t));
+    }
+  }
+
+private:
+  // closing the sockets tells the workers to exit
+  void shutdown() {
+    for (int fd : sockets)
+      ::close(fd);
+    for (pid_t pid : workers)
+      ::waitpid(pid, NULL, 0);
+    sockets.clear();
+    workers.clear();
+  }
+
+  std::vector<int> sockets;
+  std::vector<pid_t> workers;
+  std::vector<uint32_t> request;
+};
+
+} // namespace fastscancount
+#endif
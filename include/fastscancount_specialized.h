@@ -0,0 +1,177 @@
+#ifndef FASTSCANCOUNT_SPECIALIZED_H
+#define FASTSCANCOUNT_SPECIALIZED_H
+
+#include "fastscancount.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Variants of fastscancount where the threshold, and possibly the number of
+// lists, are template parameters. With a fixed number of lists, the loop over
+// the lists is fully unrolled and the iterators can live in registers.
+// fastscancount_specialized picks an instance at runtime.
+
+namespace fastscancount {
+
+// instances exist for thresholds up to this value ...
+const uint8_t specialized_max_threshold = 9;
+// ... and for these numbers of lists
+const size_t specialized_min_lists = 2;
+const size_t specialized_max_lists = 16;
+
+namespace {
+
+// counts the values of [it, ...) that are below range_end, or up to end when
+// the list finishes within the window
+template <uint8_t T>
+uint32_t *specialized_count(const uint32_t *&it_, const uint32_t *end,
+                            uint32_t last, uint8_t *deccounters,
+                            uint64_t range_end, uint32_t *out) {
+  const uint32_t *it = it_;
+  if (it == end)
+    return out;
+  if (last >= range_end) {
+    // an element >= range_end ends the loop, no need to check for the end
+    for (uint32_t val = *it; val < range_end; val = *++it) {
+      uint8_t c = deccounters[val];
+      if (c == T)
+        *out++ = val;
+      deccounters[val] = c + 1;
+    }
+  } else {
+    for (; it != end; it++) {
+      uint32_t val = *it;
+      uint8_t c = deccounters[val];
+      if (c == T)
+        *out++ = val;
+      deccounters[val] = c + 1;
+    }
+  }
+  it_ = it;
+  return out;
+}
+
+template <size_t N, uint8_t T, size_t... I>
+void fastscancount_fixed_impl(const std::vector<const std::vector<uint32_t>*> &data,
+                              std::vector<uint32_t> &out,
+                              std::index_sequence<I...>) {
+  const size_t range = 65536;
+  std::vector<uint8_t> counters(range);
+  const uint32_t *it[N] = {data[I]->data()...};
+  const uint32_t *const end[N] = {(data[I]->data() + data[I]->size())...};
+  const uint32_t last[N] = {(data[I]->empty() ? 0 : data[I]->back())...};
+  const uint32_t largest = std::max({last[I]...});
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  for (size_t start = 0; start <= largest; start += range) {
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    uint8_t *const deccounters = counters.data() - start;
+    const uint64_t range_end = start + range;
+    // unrolled over the N lists
+    ((output = specialized_count<T>(it[I], end[I], last[I], deccounters,
+                                    range_end, output)),
+     ...);
+  }
+  out.resize(output - out.data());
+}
+
+template <uint8_t T>
+void fastscancount_threshold_impl(const std::vector<const std::vector<uint32_t>*> &data,
+                                  std::vector<uint32_t> &out) {
+  const size_t range = 65536;
+  std::vector<uint8_t> counters(range);
+  struct data_info {
+    const uint32_t *cur;
+    const uint32_t *end;
+    uint32_t last;
+  };
+  std::vector<data_info> iter_data;
+  uint32_t largest = 0;
+  for (auto d : data) {
+    if (d->empty())
+      continue;
+    iter_data.push_back({d->data(), d->data() + d->size(), d->back()});
+    largest = std::max(largest, d->back());
+  }
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  for (size_t start = 0; !iter_data.empty() && start <= largest; start += range) {
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    uint8_t *const deccounters = counters.data() - start;
+    for (auto &id : iter_data) {
+      output = specialized_count<T>(id.cur, id.end, id.last, deccounters,
+                                    start + range, output);
+    }
+  }
+  out.resize(output - out.data());
+}
+
+typedef void (*specialized_kernel)(const std::vector<const std::vector<uint32_t>*> &,
+                                   std::vector<uint32_t> &);
+
+template <size_t N, size_t... T>
+constexpr std::array<specialized_kernel, sizeof...(T)>
+fixed_kernels_for(std::index_sequence<T...>) {
+  return {{[](const std::vector<const std::vector<uint32_t>*> &data,
+              std::vector<uint32_t> &out) {
+    fastscancount_fixed_impl<N, uint8_t(T)>(data, out,
+                                            std::make_index_sequence<N>());
+  }...}};
+}
+
+template <size_t... N>
+constexpr auto fixed_kernel_table(std::index_sequence<N...>) {
+  return std::array<std::array<specialized_kernel, specialized_max_threshold + 1>,
+                    sizeof...(N)>{
+      {fixed_kernels_for<N + specialized_min_lists>(
+          std::make_index_sequence<specialized_max_threshold + 1>())...}};
+}
+
+template <size_t... T>
+constexpr std::array<specialized_kernel, sizeof...(T)>
+threshold_kernel_table(std::index_sequence<T...>) {
+  return {{&fastscancount_threshold_impl<uint8_t(T)>...}};
+}
+
+} // namespace
+
+// Same result as fastscancount. Dispatches to an instance specialized for
+// both the threshold and the number of lists when there is one, then to an
+// instance specialized for the threshold, and otherwise to fastscancount.
+void fastscancount_specialized(const std::vector<const std::vector<uint32_t>*> &data,
+                               std::vector<uint32_t> &out, uint8_t threshold) {
+  static const auto fixed = fixed_kernel_table(std::make_index_sequence<
+      specialized_max_lists - specialized_min_lists + 1>());
+  static const auto by_threshold = threshold_kernel_table(
+      std::make_index_sequence<specialized_max_threshold + 1>());
+  if (threshold > specialized_max_threshold) {
+    fastscancount(data, out, threshold);
+    return;
+  }
+  const size_t n = data.size();
+  if (n >= specialized_min_lists && n <= specialized_max_lists) {
+    fixed[n - specialized_min_lists][threshold](data, out);
+  } else {
+    by_threshold[threshold](data, out);
+  }
+}
+
+} // namespace fastscancount
+#endif
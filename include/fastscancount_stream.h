@@ -0,0 +1,528 @@
+#ifndef FASTSCANCOUNT_STREAM_H
+#define FASTSCANCOUNT_STREAM_H
+
+// this code expects a POSIX system; io_uring is used on Linux when available
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define FASTSCANCOUNT_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
+// Out-of-core scancount: the postings stay in a file (in the format read by
+// MaropuGapReader: a 32-bit count followed by the 32-bit values, for each
+// list) and only the slices of the current windows are read. The reads for
+// the next window are issued asynchronously while the current window is
+// being counted.
+
+namespace fastscancount {
+
+class posting_file {
+public:
+  static const uint32_t window_size = 65536;
+
+  struct slice {
+    uint32_t window; // window number
+    uint32_t count;  // number of values
+    uint64_t offset; // position of the first value in the file, in bytes
+  };
+
+  // Scans the file once, one list at a time, to build the window directory.
+  explicit posting_file(const std::string &filename) : fd(-1) {
+    FILE *f = ::fopen(filename.c_str(), "rb");
+    if (f == NULL)
+      throw std::runtime_error("Cannot open: " + filename);
+    std::vector<uint32_t> buffer;
+    uint64_t pos = 0;
+    uint32_t qty;
+    while (fread(&qty, sizeof(qty), 1, f) == 1) {
+      pos += sizeof(qty);
+      buffer.resize(qty);
+      if (fread(buffer.data(), sizeof(uint32_t), qty, f) != qty) {
+        ::fclose(f);
+        throw std::runtime_error("The file appears to be truncated/corrupt!");
+      }
+      directory.emplace_back();
+      sizes.push_back(qty);
+      std::vector<slice> &dir = directory.back();
+      for (size_t i = 0; i < qty;) {
+        uint32_t w = buffer[i] / window_size;
+        size_t j = i + 1;
+        while (j < qty && buffer[j] / window_size == w)
+          j++;
+        dir.push_back({w, uint32_t(j - i), pos + i * sizeof(uint32_t)});
+        i = j;
+      }
+      pos += uint64_t(qty) * sizeof(uint32_t);
+    }
+    ::fclose(f);
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Cannot open: " + filename);
+  }
+
+  posting_file(const posting_file &) = delete;
+  posting_file &operator=(const posting_file &) = delete;
+
+  ~posting_file() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  int descriptor() const { return fd; }
+  size_t list_count() const { return directory.size(); }
+  size_t list_size(size_t list) const { return sizes.at(list); }
+  const std::vector<slice> &slices(size_t list) const {
+    return directory.at(list);
+  }
+
+  // reads a whole list synchronously
+  void read_list(size_t list, std::vector<uint32_t> &out) const {
+    out.clear();
+    for (const slice &s : slices(list)) {
+      size_t old = out.size();
+      out.resize(old + s.count);
+      read_fully(fd, out.data() + old, s.count * sizeof(uint32_t), s.offset);
+    }
+  }
+
+  // evicts the file from the page cache, so that the next reads hit the disk
+  void drop_cache() const {
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  }
+
+  // throws on error or premature end of file
+  static void read_fully(int fd, void *dest, size_t bytes, uint64_t offset) {
+    char *d = (char *)dest;
+    while (bytes > 0) {
+      ssize_t r = ::pread(fd, d, bytes, offset);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r <= 0)
+        throw std::runtime_error(r == 0 ? "Unexpected end of file"
+                                        : std::string("pread: ") + strerror(errno));
+      d += r;
+      bytes -= r;
+      offset += r;
+    }
+  }
+
+private:
+  int fd;
+  std::vector<std::vector<slice>> directory; // per list, sorted by window
+  std::vector<size_t> sizes;
+};
+
+// Reads are submitted one by one and wait() returns once all of them are done.
+class async_reader {
+public:
+  virtual ~async_reader() {}
+  virtual void submit(int fd, void *dest, size_t bytes, uint64_t offset) = 0;
+  // hands the reads submitted so far to the kernel without waiting for them,
+  // for readers that queue them until then
+  virtual void submit_pending() {}
+  virtual void wait() = 0;
+  virtual const char *name() const = 0;
+};
+
+// Fallback: a pool of threads calling pread.
+class pread_pool_reader : public async_reader {
+public:
+  explicit pread_pool_reader(size_t threads = 4) {
+    if (threads == 0)
+      threads = 1;
+    for (size_t i = 0; i < threads; i++)
+      workers.emplace_back([this] { work(); });
+  }
+
+  ~pread_pool_reader() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    ready.notify_all();
+    for (auto &t : workers)
+      t.join();
+  }
+
+  void submit(int fd, void *dest, size_t bytes, uint64_t offset) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back({fd, dest, bytes, offset});
+      pending++;
+    }
+    ready.notify_one();
+  }
+
+  void wait() override {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+    if (!error.empty()) {
+      std::string e;
+      e.swap(error);
+      throw std::runtime_error(e);
+    }
+  }
+
+  const char *name() const override { return "pread thread pool"; }
+
+private:
+  struct request {
+    int fd;
+    void *dest;
+    size_t bytes;
+    uint64_t offset;
+  };
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      ready.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return; // stopping
+      request r = queue.front();
+      queue.pop_front();
+      lock.unlock();
+      std::string e;
+      try {
+        posting_file::read_fully(r.fd, r.dest, r.bytes, r.offset);
+      } catch (const std::exception &ex) {
+        e = ex.what();
+      }
+      lock.lock();
+      if (!e.empty() && error.empty())
+        error = e;
+      if (--pending == 0)
+        done.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable ready, done;
+  std::deque<request> queue;
+  size_t pending = 0;
+  bool stopping = false;
+  std::string error;
+  std::vector<std::thread> workers;
+};
+
+#ifdef FASTSCANCOUNT_HAS_IO_URING
+// Minimal io_uring reader over the raw system calls (no liburing needed).
+class uring_reader : public async_reader {
+public:
+  // throws if io_uring is not available (old kernel, seccomp, ...)
+  explicit uring_reader(unsigned entries = 256) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring_fd < 0)
+      throw std::runtime_error(std::string("io_uring_setup: ") + strerror(errno));
+    sq_entries = p.sq_entries;
+    cq_entries = p.cq_entries;
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    cq_ptr = mmap(nullptr, cq_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe *)mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd,
+                                IORING_OFF_SQES);
+    if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+      release();
+      throw std::runtime_error("io_uring: cannot map the rings");
+    }
+    char *sq = (char *)sq_ptr;
+    sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq + p.sq_off.array);
+    char *cq = (char *)cq_ptr;
+    cq_head = (unsigned *)(cq + p.cq_off.head);
+    cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+  }
+
+  ~uring_reader() { release(); }
+
+  void submit(int fd, void *dest, size_t bytes, uint64_t offset) override {
+    if (bytes == 0)
+      return;
+    requests.push_back({fd, (char *)dest, bytes, offset});
+    push(requests.size() - 1);
+  }
+
+  void submit_pending() override { flush(); }
+
+  void wait() override {
+    flush();
+    while (inflight > 0) {
+      if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+        abandon(std::string("io_uring_enter: ") + strerror(errno));
+      reap();
+      flush();
+    }
+    requests.clear();
+    if (!error.empty()) {
+      std::string e;
+      e.swap(error);
+      throw std::runtime_error(e);
+    }
+  }
+
+  const char *name() const override { return "io_uring"; }
+
+private:
+  struct request {
+    int fd;
+    char *dest;
+    size_t bytes;
+    uint64_t offset;
+  };
+
+  int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    int r;
+    do {
+      r = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                       flags, nullptr, 0);
+    } while (r < 0 && errno == EINTR);
+    return r;
+  }
+
+  // queues the request, submitting or reaping when the rings are full
+  void push(size_t id) {
+    while (unsubmitted == sq_entries || inflight + unsubmitted == cq_entries) {
+      flush();
+      if (inflight == cq_entries) {
+        if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+          abandon(std::string("io_uring_enter: ") + strerror(errno));
+        reap();
+      }
+    }
+    const request &r = requests[id];
+    unsigned tail = *sq_tail; // only we write it
+    unsigned index = tail & sq_mask;
+    io_uring_sqe &sqe = sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = r.fd;
+    sqe.off = r.offset;
+    sqe.addr = (uint64_t)(uintptr_t)r.dest;
+    sqe.len = (uint32_t)std::min<size_t>(r.bytes, 1u << 30);
+    sqe.user_data = id;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted++;
+  }
+
+  void flush() {
+    while (unsubmitted > 0) {
+      int r = enter(unsubmitted, 0, 0);
+      if (r < 0)
+        abandon(std::string("io_uring_enter: ") + strerror(errno));
+      unsubmitted -= r;
+      inflight += r;
+    }
+  }
+
+  void reap() {
+    while (true) {
+      // push() may reap as well, so we reload the head every time
+      unsigned head = *cq_head;
+      if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+        break;
+      const io_uring_cqe &cqe = cqes[head & cq_mask];
+      size_t id = (size_t)cqe.user_data;
+      int res = cqe.res;
+      __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+      inflight--;
+      if (!error.empty())
+        continue; // wait() throws once everything is back
+      if (res == -EINTR || res == -EAGAIN) {
+        push(id);
+        continue;
+      }
+      if (res <= 0) {
+        error = res == 0 ? "Unexpected end of file"
+                         : std::string("io_uring read: ") + strerror(-res);
+        continue;
+      }
+      request &r = requests[id];
+      if ((size_t)res < r.bytes) { // short read: ask for the rest
+        r.dest += res;
+        r.bytes -= res;
+        r.offset += res;
+        push(id);
+      }
+    }
+  }
+
+  // The reads in flight write into the caller's buffers: they must all be
+  // back before we throw. The queued but unsubmitted ones are dropped.
+  [[noreturn]] void abandon(const std::string &why) {
+    if (error.empty())
+      error = why;
+    __atomic_store_n(sq_tail, *sq_tail - unsubmitted, __ATOMIC_RELEASE);
+    unsubmitted = 0;
+    while (inflight > 0) {
+      if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+        std::this_thread::yield(); // the completions get posted anyway
+      reap();
+    }
+    requests.clear();
+    std::string e;
+    e.swap(error);
+    throw std::runtime_error(e);
+  }
+
+  void release() {
+    if (sqes != nullptr && sqes != MAP_FAILED)
+      munmap(sqes, sqes_len);
+    if (cq_ptr != nullptr && cq_ptr != MAP_FAILED)
+      munmap(cq_ptr, cq_len);
+    if (sq_ptr != nullptr && sq_ptr != MAP_FAILED)
+      munmap(sq_ptr, sq_len);
+    if (ring_fd >= 0)
+      ::close(ring_fd);
+    sqes = nullptr;
+    cq_ptr = sq_ptr = nullptr;
+    ring_fd = -1;
+  }
+
+  int ring_fd = -1;
+  void *sq_ptr = nullptr, *cq_ptr = nullptr;
+  io_uring_sqe *sqes = nullptr;
+  size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+  unsigned sq_entries = 0, cq_entries = 0;
+  unsigned *sq_tail = nullptr, *sq_array = nullptr, sq_mask = 0;
+  unsigned *cq_head = nullptr, *cq_tail = nullptr, cq_mask = 0;
+  io_uring_cqe *cqes = nullptr;
+  unsigned unsubmitted = 0, inflight = 0;
+  std::vector<request> requests;
+  std::string error; // first failure, thrown once no read is in flight
+};
+#endif
+
+// io_uring when the system allows it, a pool of pread threads otherwise
+std::unique_ptr<async_reader> make_async_reader(size_t threads = 4) {
+#ifdef FASTSCANCOUNT_HAS_IO_URING
+  try {
+    return std::unique_ptr<async_reader>(new uring_reader());
+  } catch (const std::runtime_error &) {
+  }
+#endif
+  return std::unique_ptr<async_reader>(new pread_pool_reader(threads));
+}
+
+namespace {
+
+// the slices of all the query lists for one window, read into one buffer
+struct stream_batch {
+  int64_t window = -1;
+  std::vector<uint32_t> buffer;
+  std::vector<size_t> counts; // number of values per slice, in buffer order
+};
+
+} // namespace
+
+// Same result as fastscancount for the lists whose ids are in 'lists', but
+// reading the postings from the file, one window at a time: the slices for
+// window i+1 are read while window i is counted.
+void fastscancount_stream(const posting_file &file,
+                          const std::vector<uint32_t> &lists,
+                          std::vector<uint32_t> &out, uint8_t threshold,
+                          async_reader &reader) {
+  const size_t range = posting_file::window_size;
+  std::vector<uint8_t> counters(range);
+  std::vector<const posting_file::slice *> cur, end;
+  for (uint32_t t : lists) {
+    const auto &dir = file.slices(t);
+    if (dir.empty())
+      continue;
+    cur.push_back(dir.data());
+    end.push_back(dir.data() + dir.size());
+  }
+  // issues the reads for the next window, returns false if there is none
+  auto schedule = [&](stream_batch &b) {
+    int64_t w = -1;
+    for (size_t c = 0; c < cur.size(); c++) {
+      if (cur[c] != end[c] && (w < 0 || cur[c]->window < w))
+        w = cur[c]->window;
+    }
+    b.window = w;
+    if (w < 0)
+      return false;
+    size_t total = 0;
+    b.counts.clear();
+    for (size_t c = 0; c < cur.size(); c++) {
+      if (cur[c] != end[c] && cur[c]->window == w) {
+        b.counts.push_back(cur[c]->count);
+        total += cur[c]->count;
+      }
+    }
+    b.buffer.resize(total);
+    uint32_t *dest = b.buffer.data();
+    for (size_t c = 0; c < cur.size(); c++) {
+      if (cur[c] != end[c] && cur[c]->window == w) {
+        reader.submit(file.descriptor(), dest, cur[c]->count * sizeof(uint32_t),
+                      cur[c]->offset);
+        dest += cur[c]->count;
+        cur[c]++;
+      }
+    }
+    reader.submit_pending(); // so that the reads proceed while we count
+    return true;
+  };
+  out.clear();
+  stream_batch batches[2];
+  size_t current = 0;
+  bool more = schedule(batches[current]);
+  reader.wait();
+  while (more) {
+    stream_batch &b = batches[current];
+    more = schedule(batches[current ^ 1]); // overlaps with the counting below
+    memset(counters.data(), 0, range);
+    uint8_t *const deccounters = counters.data() - size_t(b.window) * range;
+    const uint32_t *it = b.buffer.data();
+    for (size_t count : b.counts) {
+      for (const uint32_t *itend = it + count; it != itend; it++) {
+        uint32_t val = *it;
+        uint8_t c = deccounters[val];
+        if (c == threshold)
+          out.push_back(val);
+        deccounters[val] = c + 1;
+      }
+    }
+    reader.wait();
+    current ^= 1;
+  }
+}
+
+} // namespace fastscancount
+#endif
@@ -0,0 +1,78 @@
+#ifndef FASTSCANCOUNT_UNSORTED_H
+#define FASTSCANCOUNT_UNSORTED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// scancount for lists that are not sorted. Rather than sorting them, the
+// values of all the lists are partitioned by window (their high 16 bits) in a
+// single scatter pass, after a pass that sizes the buckets. Counting does not
+// care about the order of the values within a window, nor about which list
+// they came from, so each bucket only keeps the low 16 bits and is then
+// counted like a window of fastscancount.
+
+namespace fastscancount {
+
+// Same result as fastscancount, for lists in any order. Each list must not
+// contain duplicates.
+void fastscancount_unsorted(const std::vector<const std::vector<uint32_t>*> &data,
+                            std::vector<uint32_t> &out, uint8_t threshold) {
+  const size_t range = 65536;
+  // bucket sizes, grown as larger windows show up
+  std::vector<size_t> sizes;
+  size_t total = 0;
+  for (auto d : data) {
+    for (uint32_t val : *d) {
+      const size_t w = val >> 16;
+      if (w >= sizes.size())
+        sizes.resize(w + 1);
+      sizes[w]++;
+    }
+    total += d->size();
+  }
+  std::vector<size_t> fill(sizes.size() + 1);
+  for (size_t w = 0; w < sizes.size(); w++)
+    fill[w + 1] = fill[w] + sizes[w];
+  std::vector<uint16_t> buckets(total);
+  uint16_t *const bdata = buckets.data();
+  for (auto d : data) {
+    for (uint32_t val : *d) {
+      bdata[fill[val >> 16]++] = uint16_t(val);
+    }
+  }
+  // fill[w] is now the end of bucket w, and the start of bucket w + 1
+  std::vector<uint8_t> counters(range);
+  uint8_t *const cdata = counters.data();
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  size_t begin = 0;
+  for (size_t w = 0; w < sizes.size(); w++) {
+    const size_t end = fill[w];
+    if (end - begin <= threshold) {
+      begin = end;
+      continue; // not enough values for a hit
+    }
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(cdata, 0, range);
+    const uint32_t base = uint32_t(w) << 16;
+    for (size_t i = begin; i < end; i++) {
+      uint16_t off = bdata[i];
+      uint8_t count = cdata[off];
+      if (count == threshold)
+        *output++ = base | off;
+      cdata[off] = count + 1;
+    }
+    begin = end;
+  }
+  out.resize(output - out.data());
+}
+
+} // namespace fastscancount
+#endif
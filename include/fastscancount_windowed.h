@@ -0,0 +1,138 @@
+#ifndef FASTSCANCOUNT_WINDOWED_H
+#define FASTSCANCOUNT_WINDOWED_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// A window-major index layout: the postings of all lists are cut into
+// windows of window_size values, and the slices of all the lists for window 0
+// are stored first, then those for window 1, and so forth. Each list has a
+// directory of (window, offset, count) entries, so the window loop finds each
+// slice directly and reads memory mostly sequentially.
+
+namespace fastscancount {
+
+// Smaller windows would make the directory, with one slice per list and
+// window, larger than the postings themselves.
+const uint32_t windowed_min_window_size = 4096;
+
+struct windowed_index {
+  struct slice {
+    uint32_t window; // window number: values are in [window * window_size, ...)
+    uint32_t offset; // position of the first value in postings
+    uint32_t count;  // number of values
+  };
+
+  uint32_t window_size = 65536;
+  std::vector<uint32_t> postings;            // all the slices, window-major
+  std::vector<std::vector<slice>> directory; // per list, sorted by window
+
+  size_t list_count() const { return directory.size(); }
+};
+
+void build_windowed_index(const std::vector<std::vector<uint32_t>> &lists,
+                          windowed_index &index, uint32_t window_size = 65536) {
+  if (window_size < windowed_min_window_size)
+    throw std::runtime_error("window_size must be at least windowed_min_window_size");
+  index.window_size = window_size;
+  index.postings.clear();
+  index.directory.assign(lists.size(), {});
+  // first, locate the slices
+  size_t total = 0;
+  size_t windows = 0;
+  for (size_t t = 0; t < lists.size(); t++) {
+    const std::vector<uint32_t> &v = lists[t];
+    auto &dir = index.directory[t];
+    for (size_t i = 0; i < v.size();) {
+      uint32_t w = v[i] / window_size;
+      size_t j = i + 1;
+      while (j < v.size() && v[j] / window_size == w)
+        j++;
+      dir.push_back({w, uint32_t(i), uint32_t(j - i)}); // offset into v, for now
+      windows = std::max(windows, size_t(w) + 1);
+      i = j;
+    }
+    total += v.size();
+  }
+  if (total > UINT32_MAX)
+    throw std::runtime_error("too many postings for 32-bit offsets");
+  // then lay them out, window after window
+  std::vector<std::vector<uint32_t>> per_window(windows); // list ids
+  for (size_t t = 0; t < lists.size(); t++) {
+    for (const auto &s : index.directory[t])
+      per_window[s.window].push_back(uint32_t(t));
+  }
+  std::vector<size_t> cursor(lists.size());
+  index.postings.reserve(total);
+  for (size_t w = 0; w < windows; w++) {
+    for (uint32_t t : per_window[w]) {
+      windowed_index::slice &s = index.directory[t][cursor[t]++];
+      const uint32_t *src = lists[t].data() + s.offset;
+      s.offset = uint32_t(index.postings.size());
+      index.postings.insert(index.postings.end(), src, src + s.count);
+    }
+  }
+}
+
+// Same result as fastscancount for the lists whose ids are in 'lists'.
+// Windows that none of the lists touch are skipped.
+void fastscancount_windowed(const windowed_index &index,
+                            const std::vector<uint32_t> &lists,
+                            std::vector<uint32_t> &out, uint8_t threshold) {
+  const size_t range = index.window_size;
+  std::vector<uint8_t> counters(range);
+  std::vector<const windowed_index::slice *> cur, end;
+  for (uint32_t t : lists) {
+    const auto &dir = index.directory.at(t);
+    if (dir.empty())
+      continue;
+    cur.push_back(dir.data());
+    end.push_back(dir.data() + dir.size());
+  }
+  out.resize(4 * range); // let us add lots of capacity
+  uint32_t *output = out.data();
+  const uint32_t *postings = index.postings.data();
+  while (true) {
+    // next window that one of the lists has data for
+    uint32_t w = 0;
+    bool any = false;
+    for (size_t c = 0; c < cur.size(); c++) {
+      if (cur[c] != end[c] && (!any || cur[c]->window < w)) {
+        w = cur[c]->window;
+        any = true;
+      }
+    }
+    if (!any)
+      break;
+    // make sure that the capacity is sufficient
+    size_t countsofar = output - out.data();
+    if (out.size() - countsofar < range) {
+      out.resize(out.size() + 4 * range);
+      output = out.data() + countsofar;
+    }
+    memset(counters.data(), 0, range);
+    uint8_t *const deccounters = counters.data() - size_t(w) * range;
+    for (size_t c = 0; c < cur.size(); c++) {
+      if (cur[c] == end[c] || cur[c]->window != w)
+        continue;
+      const uint32_t *it = postings + cur[c]->offset;
+      const uint32_t *itend = it + cur[c]->count;
+      for (; it != itend; it++) {
+        uint32_t val = *it;
+        uint8_t count = deccounters[val];
+        if (count == threshold)
+          *output++ = val;
+        deccounters[val] = count + 1;
+      }
+      cur[c]++;
+    }
+  }
+  out.resize(output - out.data());
+}
+
+} // namespace fastscancount
+#endif